@@ -0,0 +1,95 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Delta.h"
+#include "XMLReader.h"
+
+#include "llvm/Support/MD5.h"
+
+#include <map>
+#include <ostream>
+#include <sstream>
+
+// Compute a digest of an element as written back out, so that elements
+// read from either document are compared in the same normalized form.
+static std::string digestElement(XMLElement const& element)
+{
+  std::ostringstream text;
+  writeXMLElement(text, element);
+  llvm::MD5 md5;
+  md5.update(text.str());
+  llvm::MD5::MD5Result digest;
+  md5.final(digest);
+  std::string key(16, '\0');
+  for (size_t b = 0; b < 16; ++b) {
+    key[b] = static_cast<char>(digest[b]);
+  }
+  return key;
+}
+
+bool writeXMLDelta(std::istream& current, std::istream& previous,
+                   std::ostream& out, std::string& error)
+{
+  // Keep only a digest of each previous element.
+  XMLElementReader prevReader(previous);
+  XMLTag prevRoot;
+  if (!prevReader.readStart(prevRoot, error)) {
+    return false;
+  }
+  std::map<std::string, std::string> digests;
+  XMLElement element;
+  while (prevReader.readElement(element, error)) {
+    digests[element.getId()] = digestElement(element);
+  }
+  if (!error.empty()) {
+    return false;
+  }
+
+  XMLElementReader reader(current);
+  XMLTag root;
+  if (!reader.readStart(root, error)) {
+    return false;
+  }
+  if (root.Name != prevRoot.Name) {
+    error = "document element '" + prevRoot.Name +
+      "' of previous output does not match '" + root.Name + "'";
+    return false;
+  }
+
+  out << "<?xml version=\"1.0\"?>\n";
+  writeXMLTag(out, root, 0);
+  while (reader.readElement(element, error)) {
+    auto i = digests.find(element.getId());
+    if (i != digests.end()) {
+      bool same = i->second == digestElement(element);
+      digests.erase(i);
+      if (same) {
+        continue;
+      }
+    }
+    writeXMLElement(out, element);
+  }
+  if (!error.empty()) {
+    return false;
+  }
+
+  // Previous elements not seen above have been removed.
+  for (auto const& d : digests) {
+    out << "  <Deleted id=\"" << d.first << "\"/>\n";
+  }
+  out << "</" << root.Name << ">\n";
+  return true;
+}
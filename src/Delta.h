@@ -0,0 +1,29 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#ifndef CASTXML_DELTA_H
+#define CASTXML_DELTA_H
+
+#include <iosfwd>
+#include <string>
+
+/// writeXMLDelta - Write the elements of 'current' castxml output that
+/// are new or differ from the element with the same id in 'previous',
+/// followed by a Deleted element for each id of 'previous' that no
+/// longer appears.  On failure returns false and stores a message.
+bool writeXMLDelta(std::istream& current, std::istream& previous,
+                   std::ostream& out, std::string& error);
+
+#endif // CASTXML_DELTA_H
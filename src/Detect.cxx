@@ -28,19 +28,36 @@
 #  include "llvm/Support/Host.h"
 #endif
 
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Driver/Compilation.h"
+#include "clang/Driver/Driver.h"
+#include "clang/Driver/Tool.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/Utils.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/Preprocessor.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+#if LLVM_VERSION_MAJOR >= 20
+#  include "llvm/Support/VirtualFileSystem.h"
+#endif
 
 #include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <string.h>
 
-static std::string getClangBuiltinIncludeDir()
+static std::string getClangBuiltinIncludeDir(Options const& opts)
 {
-  return getClangResourceDir() + "/include";
+  return opts.ClangResourceDir + "/include";
 }
 
 static bool failedCC(char const* id, std::vector<char const*> const& args,
@@ -130,13 +147,203 @@ static bool isBuiltinIncludeDir(std::string const& inc)
   );
 }
 
-static bool detectCC_GNU(char const* const* argBeg, char const* const* argEnd,
-                         Options& opts, char const* id, char const* ext)
+static void addInclude(Options& opts, std::string inc)
 {
   std::string const fwExplicitSuffix = " (framework directory)";
   std::string const fwImplicitSuffix = "/Frameworks";
+  std::replace(inc.begin(), inc.end(), '\\', '/');
+  bool fw = ((inc.size() > fwExplicitSuffix.size()) &&
+             (inc.substr(inc.size() - fwExplicitSuffix.size()) ==
+              fwExplicitSuffix));
+  if (fw) {
+    inc = inc.substr(0, inc.size() - fwExplicitSuffix.size());
+  } else {
+    fw = ((inc.size() > fwImplicitSuffix.size()) &&
+          (inc.substr(inc.size() - fwImplicitSuffix.size()) ==
+           fwImplicitSuffix));
+  }
+  // Replace the compiler builtin include directory with ours.
+  if (!fw && isBuiltinIncludeDir(inc)) {
+    inc = getClangBuiltinIncludeDir(opts);
+  }
+  opts.Includes.push_back(Options::Include(inc, fw));
+}
+
+#if LLVM_VERSION_MAJOR >= 9
+namespace {
+/// Print the predefined macros and record the '#include <...>' search
+/// path, as 'cc -E -dM -v' would.
+class DetectAction : public clang::PreprocessorFrontendAction
+{
+  std::string& Predefines;
+  std::vector<std::string>& SearchPath;
+
+public:
+  DetectAction(std::string& predefines, std::vector<std::string>& searchPath)
+    : Predefines(predefines)
+    , SearchPath(searchPath)
+  {
+  }
+
+protected:
+  void ExecuteAction() override
+  {
+    clang::CompilerInstance& CI = this->getCompilerInstance();
+    clang::Preprocessor& PP = CI.getPreprocessor();
+    clang::HeaderSearch& hs = PP.getHeaderSearchInfo();
+    for (auto i = hs.angled_dir_begin(), e = hs.search_dir_end(); i != e;
+         ++i) {
+      if (i->isHeaderMap()) {
+        continue;
+      }
+      std::string dir = i->getName().str();
+      if (i->isFramework()) {
+        dir += " (framework directory)";
+      }
+      this->SearchPath.push_back(dir);
+    }
+    llvm::raw_string_ostream os(this->Predefines);
+    clang::DoPrintPreprocessedInput(PP, &os, CI.getPreprocessorOutputOpts());
+  }
+};
+}
+
+static bool isClangOfThisRelease(char const* cc, std::string& exe)
+{
+  // The internal Clang.
+  if (strcmp(cc, "<clang>") == 0) {
+    exe = "clang";
+    return true;
+  }
+
+  // A clang binary of the LLVM/Clang installation the internal Clang is
+  // from, whose predefines therefore match.  It is recognized by its
+  // resource directory.  Matching on the version in the name of that
+  // directory is not enough, since it holds only the major version
+  // as of LLVM 16.
+  llvm::ErrorOr<std::string> maybeProg = llvm::sys::findProgramByName(cc);
+  if (!maybeProg) {
+    return false;
+  }
+  llvm::SmallString<256> realProg;
+  if (llvm::sys::fs::real_path(*maybeProg, realProg)) {
+    return false;
+  }
+  llvm::StringRef name = llvm::sys::path::filename(realProg);
+  if (name.substr(0, 5) != "clang" || name.substr(0, 8) == "clang-cl") {
+    return false;
+  }
+  std::string resourceDir =
+    clang::driver::Driver::GetResourcesPath(realProg.str());
+  llvm::SmallString<256> realResourceDir;
+  llvm::SmallString<256> internalResourceDir;
+  if (llvm::sys::fs::real_path(resourceDir, realResourceDir) ||
+      llvm::sys::fs::real_path(CASTXML_CLANG_RESOURCE_DIR,
+                               internalResourceDir) ||
+      realResourceDir != internalResourceDir) {
+    return false;
+  }
+  exe = std::string(realProg.str());
+  return true;
+}
+
+static bool detectCC_Clang(char const* const* argBeg,
+                           char const* const* argEnd, Options& opts,
+                           char const* ext)
+{
+  std::string exe;
+  if (!isClangOfThisRelease(*argBeg, exe)) {
+    return false;
+  }
+
+  // Diagnostics are dropped.  On failure the caller runs the compiler
+  // as a separate process, which reports them.
+#  if LLVM_VERSION_MAJOR >= 21
+  clang::DiagnosticOptions diagOpts;
+  clang::DiagnosticOptions& diagOptsPtr = diagOpts;
+#  else
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> diagOpts(
+    new clang::DiagnosticOptions);
+  clang::DiagnosticOptions* diagOptsPtr = diagOpts.get();
+#  endif
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticIDs> diagID(
+    new clang::DiagnosticIDs());
+  clang::IgnoringDiagConsumer diagClient;
+  clang::DiagnosticsEngine diags(diagID, diagOptsPtr, &diagClient,
+                                 /*ShouldOwnClient=*/false);
+
+  // Let the driver compute the preprocessor job for the compiler.
+  clang::driver::Driver d(exe, llvm::sys::getDefaultTargetTriple(), diags);
+  if (!llvm::sys::path::is_absolute(d.ResourceDir) ||
+      !llvm::sys::fs::is_directory(d.ResourceDir)) {
+    d.ResourceDir = opts.ClangResourceDir;
+  }
+  std::string empty_src = opts.ResourceDir + "/empty." + ext;
+  llvm::SmallVector<char const*, 16> cc_args(argBeg, argEnd);
+  cc_args.push_back("-E");
+  cc_args.push_back("-dM");
+  cc_args.push_back(empty_src.c_str());
+  std::unique_ptr<clang::driver::Compilation> c(d.BuildCompilation(cc_args));
+  if (!c || diags.hasErrorOccurred() || c->getJobs().size() != 1) {
+    return false;
+  }
+  clang::driver::Command const* cmd =
+    llvm::dyn_cast<clang::driver::Command>(&*c->getJobs().begin());
+  if (!cmd || strcmp(cmd->getCreator().getName(), "clang") != 0) {
+    return false;
+  }
+
+  // Run the preprocessor job in this process.
+  std::unique_ptr<clang::CompilerInstance> CI(new clang::CompilerInstance());
+  char const* const* cmdArgBeg = cmd->getArguments().data();
+  char const* const* cmdArgEnd = cmdArgBeg + cmd->getArguments().size();
+  if (!clang::CompilerInvocation::CreateFromArgs(
+        CI->getInvocation(),
+#  if LLVM_VERSION_MAJOR >= 16
+        llvm::ArrayRef(cmdArgBeg, cmdArgEnd),
+#  elif LLVM_VERSION_MAJOR >= 10
+        llvm::makeArrayRef(cmdArgBeg, cmdArgEnd),
+#  else
+        cmdArgBeg, cmdArgEnd,
+#  endif
+        diags) ||
+      diags.hasErrorOccurred()) {
+    return false;
+  }
+  CI->createDiagnostics(
+#  if LLVM_VERSION_MAJOR >= 20 && LLVM_VERSION_MAJOR < 22
+    *llvm::vfs::getRealFileSystem(),
+#  endif
+    &diagClient, /*ShouldOwnClient=*/false);
+  std::string predefines;
+  std::vector<std::string> searchPath;
+  DetectAction action(predefines, searchPath);
+  if (!CI->ExecuteAction(action) || CI->getDiagnostics().hasErrorOccurred()) {
+    return false;
+  }
+
+  opts.Predefines = predefines;
+  for (std::string const& inc : searchPath) {
+    addInclude(opts, inc);
+  }
+  fixPredefines(opts);
+  setTriple(opts);
+  return true;
+}
+#endif
+
+static bool detectCC_GNU(char const* const* argBeg, char const* const* argEnd,
+                         Options& opts, char const* id, char const* ext)
+{
+#if LLVM_VERSION_MAJOR >= 9
+  // Avoid running a compiler process if the compiler is our Clang.
+  if (detectCC_Clang(argBeg, argEnd, opts, ext)) {
+    return true;
+  }
+#endif
+
   std::vector<char const*> cc_args(argBeg, argEnd);
-  std::string empty_cpp = getResourceDir() + "/empty." + ext;
+  std::string empty_cpp = opts.ResourceDir + "/empty." + ext;
   int ret;
   std::string out;
   std::string err;
@@ -158,23 +365,7 @@ static bool detectCC_GNU(char const* const* argBeg, char const* const* argEnd,
             if (*(e - 1) == '\r') {
               --e;
             }
-            std::string inc(s, e - s);
-            std::replace(inc.begin(), inc.end(), '\\', '/');
-            bool fw = ((inc.size() > fwExplicitSuffix.size()) &&
-                       (inc.substr(inc.size() - fwExplicitSuffix.size()) ==
-                        fwExplicitSuffix));
-            if (fw) {
-              inc = inc.substr(0, inc.size() - fwExplicitSuffix.size());
-            } else {
-              fw = ((inc.size() > fwImplicitSuffix.size()) &&
-                    (inc.substr(inc.size() - fwImplicitSuffix.size()) ==
-                     fwImplicitSuffix));
-            }
-            // Replace the compiler builtin include directory with ours.
-            if (!fw && isBuiltinIncludeDir(inc)) {
-              inc = getClangBuiltinIncludeDir();
-            }
-            opts.Includes.push_back(Options::Include(inc, fw));
+            addInclude(opts, std::string(s, e - s));
           }
         }
       }
@@ -191,7 +382,7 @@ static bool detectCC_MSVC(char const* const* argBeg, char const* const* argEnd,
                           Options& opts, char const* id, char const* ext)
 {
   std::vector<char const*> cc_args(argBeg, argEnd);
-  std::string detect_vs_cpp = getResourceDir() + "/detect_vs." + ext;
+  std::string detect_vs_cpp = opts.ResourceDir + "/detect_vs." + ext;
   int ret;
   std::string out;
   std::string err;
@@ -217,9 +408,11 @@ static bool detectCC_MSVC(char const* const* argBeg, char const* const* argEnd,
   cc_args.push_back(detect_vs_cpp.c_str());
   cc_args.push_back(argFo.c_str());
 
-  // Run the compiler.
-  bool success =
-    runCommand(int(cc_args.size()), &cc_args[0], ret, out, err, msg) &&
+  // Run the compiler, reusing the temporary directory if its output
+  // must be captured through files.
+  std::string tmpDirStr(tmpDir.str());
+  bool success = runCommand(int(cc_args.size()), &cc_args[0], ret, out, err,
+                            msg, &tmpDirStr) &&
     ret == 0;
 
   // Remove temporary object file and directory.
@@ -0,0 +1,137 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "FileCache.h"
+
+#if LLVM_VERSION_MAJOR >= 9
+
+#  include "llvm/Support/MemoryBuffer.h"
+
+#  include <map>
+#  include <memory>
+#  include <mutex>
+#  include <string>
+
+namespace {
+
+/// A file whose contents were read by a SharedFileCache.
+class CachedFile : public llvm::vfs::File
+{
+  llvm::vfs::Status Status;
+  std::shared_ptr<llvm::MemoryBuffer> Buffer;
+
+public:
+  CachedFile(llvm::vfs::Status const& status,
+             std::shared_ptr<llvm::MemoryBuffer> buffer)
+    : Status(status)
+    , Buffer(std::move(buffer))
+  {
+  }
+
+  llvm::ErrorOr<llvm::vfs::Status> status() override { return this->Status; }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> getBuffer(
+    llvm::Twine const& name, int64_t, bool requiresNullTerminator,
+    bool) override
+  {
+    // The cached buffer is null-terminated, so it can be shared for
+    // either kind of request.
+    return llvm::MemoryBuffer::getMemBuffer(this->Buffer->getBuffer(),
+                                            name.str(),
+                                            requiresNullTerminator);
+  }
+
+  std::error_code close() override { return std::error_code(); }
+};
+
+class SharedFileCache : public llvm::vfs::ProxyFileSystem
+{
+  struct Entry
+  {
+    llvm::vfs::Status Status;
+    std::shared_ptr<llvm::MemoryBuffer> Buffer;
+  };
+
+  std::mutex Mutex;
+  std::map<std::string, llvm::ErrorOr<llvm::vfs::Status>> Stats;
+  std::map<std::string, Entry> Files;
+
+public:
+  SharedFileCache()
+    : ProxyFileSystem(llvm::vfs::getRealFileSystem())
+  {
+  }
+
+  llvm::ErrorOr<llvm::vfs::Status> status(llvm::Twine const& path) override
+  {
+    std::string key = path.str();
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      auto i = this->Stats.find(key);
+      if (i != this->Stats.end()) {
+        return i->second;
+      }
+    }
+    llvm::ErrorOr<llvm::vfs::Status> s = this->ProxyFileSystem::status(key);
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    return this->Stats.emplace(key, s).first->second;
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(
+    llvm::Twine const& path) override
+  {
+    std::string key = path.str();
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      auto i = this->Files.find(key);
+      if (i != this->Files.end()) {
+        return std::unique_ptr<llvm::vfs::File>(
+          new CachedFile(i->second.Status, i->second.Buffer));
+      }
+    }
+
+    // Read the file without holding the lock.  If another thread reads
+    // it at the same time, the first to finish provides the entry.
+    auto file = this->ProxyFileSystem::openFileForRead(key);
+    if (!file) {
+      return file.getError();
+    }
+    llvm::ErrorOr<llvm::vfs::Status> s = (*file)->status();
+    if (!s) {
+      return s.getError();
+    }
+    auto buffer = (*file)->getBuffer(key);
+    if (!buffer) {
+      return buffer.getError();
+    }
+    Entry entry;
+    entry.Status = *s;
+    entry.Buffer = std::move(*buffer);
+
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    Entry const& e = this->Files.emplace(key, entry).first->second;
+    return std::unique_ptr<llvm::vfs::File>(
+      new CachedFile(e.Status, e.Buffer));
+  }
+};
+}
+
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> createSharedFileCache()
+{
+  return new SharedFileCache;
+}
+
+#endif
@@ -0,0 +1,31 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#ifndef CASTXML_FILECACHE_H
+#define CASTXML_FILECACHE_H
+
+#include "llvm/Config/llvm-config.h"
+
+#if LLVM_VERSION_MAJOR >= 9
+#  include "llvm/ADT/IntrusiveRefCntPtr.h"
+#  include "llvm/Support/VirtualFileSystem.h"
+
+/// createSharedFileCache - Create a file system over the real one that
+/// looks up the status and reads the contents of each file only once,
+/// and may be shared by compiler instances running in several threads.
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> createSharedFileCache();
+#endif
+
+#endif // CASTXML_FILECACHE_H
@@ -0,0 +1,993 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Main.h"
+#include "Detect.h"
+#include "Options.h"
+#include "RunClang.h"
+#include "Utils.h"
+
+#include "llvm/Config/llvm-config.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#if LLVM_VERSION_MAJOR > 3 ||                                                 \
+  LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR >= 7
+#  include "llvm/Support/StringSaver.h"
+#else
+class StringSaver : public llvm::cl::StringSaver
+{
+  std::set<std::string> Strings;
+
+public:
+  char const* SaveString(char const* s)
+  {
+    return this->Strings.insert(s).first->c_str();
+  }
+};
+#endif
+
+static std::string targetOutputFile(std::string const& file,
+                                    std::string const& triple)
+{
+  // Insert the triple before the extension, e.g. 'out.<triple>.xml'.
+  llvm::SmallString<128> f(file);
+  std::string ext = triple + std::string(llvm::sys::path::extension(f));
+  llvm::sys::path::replace_extension(f, ext);
+  return std::string(f.str());
+}
+
+static int runTargets(Options const& opts, char const* cc_id,
+                      llvm::SmallVectorImpl<char const*> const& cc_args,
+                      llvm::SmallVectorImpl<char const*> const& clang_args)
+{
+  std::vector<Options> targets(opts.Targets.size(), opts);
+  for (size_t i = 0; i < targets.size(); ++i) {
+    targets[i].Targets.clear();
+    targets[i].Triple = opts.Targets[i];
+    targets[i].OutputFile = targetOutputFile(opts.OutputFile, opts.Targets[i]);
+    if (!opts.ImplicitMemberReport.empty()) {
+      targets[i].ImplicitMemberReport =
+        targetOutputFile(opts.ImplicitMemberReport, opts.Targets[i]);
+    }
+  }
+
+  if (cc_id) {
+    // Detect the compiler settings for all targets concurrently.
+    std::vector<char> detected(targets.size(), 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < targets.size(); ++i) {
+      threads.emplace_back([&, i]() {
+        std::vector<char const*> args(cc_args.begin(), cc_args.end());
+        args.push_back("-target");
+        args.push_back(opts.Targets[i].c_str());
+        detected[i] = detectCC(cc_id, args.data(), args.data() + args.size(),
+                               targets[i]);
+        targets[i].Triple = opts.Targets[i];
+      });
+    }
+    for (std::thread& t : threads) {
+      t.join();
+    }
+    for (char d : detected) {
+      if (!d) {
+        return 1;
+      }
+    }
+  }
+
+  return runClangTargets(clang_args.data(),
+                         clang_args.data() + clang_args.size(), targets);
+}
+
+static void initializeTargets()
+{
+  llvm::InitializeAllTargets();
+  llvm::InitializeAllTargetMCs();
+  llvm::InitializeAllAsmPrinters();
+  llvm::InitializeAllAsmParsers();
+}
+
+int castxmlMain(int argc_in, char const* const* argv_in,
+                std::string const& exe, OutputSink* sink)
+{
+  static std::once_flag targetsInitialized;
+  std::call_once(targetsInitialized, initializeTargets);
+
+  llvm::SmallVector<char const*, 64> argv(argv_in, argv_in + argc_in);
+
+#if LLVM_VERSION_MAJOR > 3 ||                                                 \
+  LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR >= 8
+  llvm::BumpPtrAllocator argSaverAlloc;
+  llvm::StringSaver argSaver(argSaverAlloc);
+#elif LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR == 7
+  llvm::BumpPtrAllocator argSaverAlloc;
+  llvm::BumpPtrStringSaver argSaver(argSaverAlloc);
+#else
+  StringSaver argSaver;
+#endif
+  llvm::cl::ExpandResponseFiles(argSaver, llvm::cl::TokenizeGNUCommandLine,
+                                argv);
+
+  size_t const argc = argv.size();
+
+  Options opts;
+  opts.Sink = sink;
+  if (!findResourceDir(exe, opts.ResourceDir, opts.ClangResourceDir,
+                       std::cerr)) {
+    return 1;
+  }
+
+  /* clang-format off */
+  const char* usage =
+    "Usage: castxml ( <castxml-opt> | <clang-opt> | <src> )...\n"
+    "\n"
+    "  Options interpreted by castxml are listed below.\n"
+    "  Remaining options are given to the internal Clang compiler.\n"
+    "\n"
+    "Options:\n"
+    "\n"
+    "  --castxml-cc-<id> <cc>\n"
+    "  --castxml-cc-<id> \"(\" <cc> <cc-opt>... \")\"\n"
+    "    Configure the internal Clang preprocessor and target\n"
+    "    platform to match that of the given compiler command.\n"
+    "    The <id> must be \"gnu\", \"msvc\", \"gnu-c\", or \"msvc-c\".\n"
+    "    <cc> names a compiler (e.g. \"gcc\") and <cc-opt>... specifies\n"
+    "    options that may affect its target (e.g. \"-m32\").\n"
+    "    The <cc> \"<clang>\" names the internal Clang compiler.\n"
+    "\n"
+    "  --castxml-output=<v>\n"
+    "    Write castxml-format output to <src>.xml or file named by '-o'\n"
+    "    The <v> specifies the \"epic\" format version number to generate,\n"
+    "    and must be '1'.\n"
+    "\n"
+    "  --castxml-gccxml\n"
+    "    Write gccxml-format output to <src>.xml or file named by '-o'\n"
+    "    Use this option if you need an output similar to the one generated\n"
+    "    by the legacy gccxml tool.\n"
+    "\n"
+    "  --castxml-start <name>[,<name>]...\n"
+    "    Start AST traversal at declaration(s) with the given (qualified)\n"
+    "    name(s).  Name components may use '*' and '?' wildcards.\n"
+    "    Multiple names may be specified as a comma-separated\n"
+    "    list or by repeating the option.\n"
+    "\n"
+    "  --castxml-exclude <name>[,<name>]...\n"
+    "    Do not traverse declaration(s) with the given (qualified)\n"
+    "    name(s).  Name components may use '*' and '?' wildcards.\n"
+    "    Excluded declarations appear only as incomplete references.\n"
+    "    Multiple names may be specified as a comma-separated\n"
+    "    list or by repeating the option.\n"
+    "\n"
+    "  --castxml-query <file> <name>[,<name>]...\n"
+    "    After writing the main output, also write output to <file>\n"
+    "    starting AST traversal at declaration(s) with the given\n"
+    "    (qualified) name(s).  The translation unit is parsed only\n"
+    "    once.  May be repeated to write several outputs.\n"
+    "\n"
+    "  --castxml-unity <header>[,<header>]...\n"
+    "    Parse one translation unit that includes the given headers\n"
+    "    in order instead of a source file.  Each File element lists\n"
+    "    the headers from which it was reached.  Multiple headers may\n"
+    "    be specified as a comma-separated list or by repeating the\n"
+    "    option.  Requires an output format option.\n"
+    "\n"
+    "  --castxml-virtual-file <path> <contents>\n"
+    "    Make a file with the given contents appear at <path> while\n"
+    "    parsing without writing it to disk.  It may be an input\n"
+    "    source file or a header.  Use a response file for contents\n"
+    "    spanning several lines.  May be repeated.\n"
+    "\n"
+    "  --castxml-targets <triple>[,<triple>]...\n"
+    "    Parse once for each target concurrently and write each output\n"
+    "    to the file named by '-o' with the target inserted before its\n"
+    "    extension.  With '--castxml-cc-<id>' the compiler is given\n"
+    "    '-target <triple>'.  Requires an output format option.\n"
+    "\n"
+    "  --castxml-emit-ast <file>\n"
+    "    Save the finished AST to <file> for use with\n"
+    "    '--castxml-from-ast'.  Requires an output format option.\n"
+    "\n"
+    "  --castxml-from-ast <file>\n"
+    "    Load an AST saved by '--castxml-emit-ast' instead of\n"
+    "    parsing a source file.\n"
+    "\n"
+    "  --castxml-order=<v>\n"
+    "    Write elements in the given order.  The <v> may be\n"
+    "    'discovery' (default) to write elements as they are found or\n"
+    "    'dependency' to write elements after those they reference.\n"
+    "\n"
+    "  --castxml-hash\n"
+    "    Add a hash=\"...\" attribute to every element computed from its\n"
+    "    attributes and the elements it references, but not their ids.\n"
+    "\n"
+    "  --castxml-index <file>\n"
+    "    Write the byte offset and length of each output element and\n"
+    "    the qualified names of namespace-scope declarations to <file>.\n"
+    "\n"
+    "  --castxml-shard-by=<v>\n"
+    "    Write elements to several files named like the output with\n"
+    "    a shard number before the extension, and write a manifest\n"
+    "    of the shards as the output.  The <v> selects the partition:\n"
+    "    'namespace' by top-level namespace or 'start' by start name.\n"
+    "\n"
+    "  --castxml-delta <xml>\n"
+    "    Write only elements that are new or differ from those in <xml>,\n"
+    "    an earlier output written with '--castxml-stable-ids', and a\n"
+    "    Deleted element for each id that no longer appears.\n"
+    "    Implies '--castxml-stable-ids'.\n"
+    "\n"
+    "  --castxml-location-columns\n"
+    "    Add column and file_offset attributes to source locations.\n"
+    "    Only for '--castxml-output=<v>'.\n"
+    "\n"
+    "  --castxml-referenced-specializations\n"
+    "    Do not list implicit instantiations of member templates among\n"
+    "    the members of their context.  They are written only when\n"
+    "    reached otherwise, e.g. as a referenced type, a base class,\n"
+    "    or through a start name naming their template.\n"
+    "\n"
+    "  --castxml-skip-function-bodies\n"
+    "    Do not parse function bodies.  Bodies of constexpr functions\n"
+    "    and functions with deduced return types are still parsed.\n"
+    "    Output may lack instantiations, lambdas, and implicit members\n"
+    "    used only inside skipped bodies, whose errors are also not\n"
+    "    diagnosed.\n"
+    "\n"
+    "  --castxml-implicit-member-budget <key>=<n>[,<key>=<n>]...\n"
+    "    Limit the work spent adding implicit members (constructors,\n"
+    "    destructors, assignment operators) to classes.  The <key> may\n"
+    "    be 'depth' for the nesting depth of classes defined while\n"
+    "    adding them (default 16), 'classes' for the number of classes,\n"
+    "    or 'ms' for the time in milliseconds.  Classes over budget get\n"
+    "    no implicit members and are marked in castxml-format output.\n"
+    "\n"
+    "  --castxml-implicit-member-report <file>\n"
+    "    Write the classes that were over the implicit member budget\n"
+    "    to <file>, one per line after the name of the budget.\n"
+    "\n"
+    "  --castxml-max-rss <mib>\n"
+    "    Fail with an error as soon as the resident set size of the\n"
+    "    process exceeds <mib> MiB while parsing or before writing\n"
+    "    output.  The parser and semantic analysis state are released\n"
+    "    before output is written.\n"
+    "\n"
+    "  --castxml-stable-ids\n"
+    "    Derive element ids from a hash of each declaration's qualified\n"
+    "    name or each type's spelling instead of numbering them in\n"
+    "    traversal order, so that ids do not change between runs.\n"
+    "\n"
+    "  -help, --help\n"
+    "    Print castxml and internal Clang compiler usage information\n"
+    "\n"
+    "  -o <file>\n"
+    "    Write output to <file>\n"
+    "\n"
+    "  --version\n"
+    "    Print castxml and internal Clang compiler version information\n"
+    "\n"
+    ;
+  /* clang-format on */
+
+  llvm::SmallVector<char const*, 16> clang_args;
+  llvm::SmallVector<char const*, 16> cc_args;
+  char const* cc_id = 0;
+
+  for (size_t i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--castxml-gccxml") == 0) {
+      if (!opts.GccXml) {
+        opts.GccXml = true;
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: '--castxml-gccxml' may be given at most once!\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strncmp(argv[i], "--castxml-output=", 17) == 0) {
+      if (!opts.CastXml) {
+        opts.CastXml = true;
+        opts.CastXmlEpicFormatVersion = atoi(argv[i] + 17);
+        if (opts.CastXmlEpicFormatVersion != 1) {
+          /* clang-format off */
+            std::cerr <<
+              "error: '--castxml-output=<v>' accepts only '1' as '<v>'!\n"
+              "\n" <<
+              usage
+              ;
+          /* clang-format on */
+        }
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: '--castxml-output=<v>' may be given at most once!\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-start") == 0) {
+      if ((i + 1) < argc) {
+        std::string item;
+        std::stringstream stream(argv[++i]);
+        while (std::getline(stream, item, ',')) {
+          opts.StartNames.push_back(item);
+        }
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '--castxml-start' is missing "
+          "(expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-unity") == 0) {
+      if ((i + 1) < argc) {
+        std::string item;
+        std::stringstream stream(argv[++i]);
+        while (std::getline(stream, item, ',')) {
+          opts.UnityHeaders.push_back(item);
+        }
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '--castxml-unity' is missing "
+          "(expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-virtual-file") == 0) {
+      if ((i + 2) < argc) {
+        opts.VirtualFiles.emplace_back(argv[i + 1], argv[i + 2]);
+        i += 2;
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: arguments to '--castxml-virtual-file' are missing "
+          "(expected 2 values)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-targets") == 0) {
+      if ((i + 1) < argc) {
+        std::string item;
+        std::stringstream stream(argv[++i]);
+        while (std::getline(stream, item, ',')) {
+          opts.Targets.push_back(item);
+        }
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '--castxml-targets' is missing "
+          "(expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-exclude") == 0) {
+      if ((i + 1) < argc) {
+        std::string item;
+        std::stringstream stream(argv[++i]);
+        while (std::getline(stream, item, ',')) {
+          opts.ExcludeNames.push_back(item);
+        }
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '--castxml-exclude' is missing "
+          "(expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-query") == 0) {
+      if ((i + 2) < argc) {
+        opts.Queries.emplace_back(argv[++i]);
+        std::string item;
+        std::stringstream stream(argv[++i]);
+        while (std::getline(stream, item, ',')) {
+          opts.Queries.back().StartNames.push_back(item);
+        }
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: arguments to '--castxml-query' are missing "
+          "(expected 2 values)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-emit-ast") == 0) {
+      if ((i + 1) < argc) {
+        opts.EmitAST = argv[++i];
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '--castxml-emit-ast' is missing "
+          "(expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strncmp(argv[i], "--castxml-order=", 16) == 0) {
+      std::string order = argv[i] + 16;
+      if (order == "dependency") {
+        opts.DependencyOrder = true;
+      } else if (order == "discovery") {
+        opts.DependencyOrder = false;
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: '--castxml-order=<v>' accepts only 'discovery'"
+          " or 'dependency' as '<v>'!\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-hash") == 0) {
+      opts.Hashes = true;
+    } else if (strcmp(argv[i], "--castxml-delta") == 0) {
+      if ((i + 1) < argc) {
+        opts.Delta = argv[++i];
+        opts.StableIds = true;
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '--castxml-delta' is missing "
+          "(expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strncmp(argv[i], "--castxml-shard-by=", 19) == 0) {
+      opts.ShardBy = argv[i] + 19;
+      if (opts.ShardBy != "namespace" && opts.ShardBy != "start") {
+        /* clang-format off */
+        std::cerr <<
+          "error: '--castxml-shard-by=<v>' accepts only 'namespace'"
+          " or 'start' as '<v>'!\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-index") == 0) {
+      if ((i + 1) < argc) {
+        opts.IndexFile = argv[++i];
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '--castxml-index' is missing "
+          "(expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-from-ast") == 0) {
+      if ((i + 1) < argc) {
+        // Clang reads serialized ASTs given as '-x ast' inputs.
+        clang_args.push_back("-x");
+        clang_args.push_back("ast");
+        clang_args.push_back(argv[++i]);
+        clang_args.push_back("-x");
+        clang_args.push_back("none");
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '--castxml-from-ast' is missing "
+          "(expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-location-columns") == 0) {
+      opts.LocationColumns = true;
+    } else if (strcmp(argv[i], "--castxml-referenced-specializations") ==
+               0) {
+      opts.ReferencedSpecializations = true;
+    } else if (strcmp(argv[i], "--castxml-skip-function-bodies") == 0) {
+      opts.SkipFunctionBodies = true;
+    } else if (strcmp(argv[i], "--castxml-stable-ids") == 0) {
+      opts.StableIds = true;
+    } else if (strcmp(argv[i], "--castxml-implicit-member-budget") == 0) {
+      if ((i + 1) < argc) {
+        std::string item;
+        std::stringstream stream(argv[++i]);
+        while (std::getline(stream, item, ',')) {
+          std::string::size_type eq = item.find('=');
+          std::string key = item.substr(0, eq);
+          unsigned int* value = nullptr;
+          if (key == "depth") {
+            value = &opts.ImplicitMemberDepth;
+          } else if (key == "classes") {
+            value = &opts.ImplicitMemberClasses;
+          } else if (key == "ms") {
+            value = &opts.ImplicitMemberTime;
+          }
+          char const* num =
+            eq == std::string::npos ? "" : item.c_str() + eq + 1;
+          char* end = nullptr;
+          unsigned long n = std::strtoul(num, &end, 10);
+          if (!value || !*num || *end || *num == '-' || n > ~0u - 1) {
+            /* clang-format off */
+            std::cerr <<
+              "error: '--castxml-implicit-member-budget' accepts only"
+              " 'depth=<n>', 'classes=<n>', or 'ms=<n>' but got '" <<
+              item << "'!\n"
+              "\n" <<
+              usage
+              ;
+            /* clang-format on */
+            return 1;
+          }
+          *value = static_cast<unsigned int>(n);
+        }
+        opts.HaveImplicitMemberBudget = true;
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '--castxml-implicit-member-budget' is missing "
+          "(expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-implicit-member-report") == 0) {
+      if ((i + 1) < argc) {
+        opts.ImplicitMemberReport = argv[++i];
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '--castxml-implicit-member-report' is missing "
+          "(expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--castxml-max-rss") == 0) {
+      if ((i + 1) < argc) {
+        char* end = nullptr;
+        opts.MaxRSS = std::strtoull(argv[++i], &end, 10);
+        if (!*argv[i] || *end || *argv[i] == '-' || opts.MaxRSS == 0) {
+          /* clang-format off */
+          std::cerr <<
+            "error: '--castxml-max-rss' accepts only a positive"
+            " number of MiB!\n"
+            "\n" <<
+            usage
+            ;
+          /* clang-format on */
+          return 1;
+        }
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '--castxml-max-rss' is missing "
+          "(expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strncmp(argv[i], "--castxml-cc-", 13) == 0) {
+      if (!cc_id) {
+        cc_id = argv[i] + 13;
+        if ((i + 1) >= argc) {
+          continue;
+        }
+        ++i;
+        if (strncmp(argv[i], "-", 1) == 0) {
+          /* clang-format off */
+          std::cerr <<
+            "error: argument to '--castxml-cc-" << cc_id <<
+            "' may not start with '-'\n"
+            "\n" <<
+            usage
+            ;
+          /* clang-format on */
+          return 1;
+        }
+        if (strcmp(argv[i], "(") == 0) {
+          unsigned int depth = 1;
+          for (++i; i < argc && depth > 0; ++i) {
+            if (strncmp(argv[i], "--castxml-", 10) == 0) {
+              /* clang-format off */
+              std::cerr <<
+                "error: arguments to '--castxml-cc-" << cc_id <<
+                "' may not start with '--castxml-'\n"
+                "\n" <<
+                usage
+                ;
+              /* clang-format on */
+              return 1;
+            } else if (strcmp(argv[i], "(") == 0) {
+              ++depth;
+              cc_args.push_back(argv[i]);
+            } else if (strcmp(argv[i], ")") == 0) {
+              if (--depth) {
+                cc_args.push_back(argv[i]);
+              }
+            } else {
+              cc_args.push_back(argv[i]);
+            }
+          }
+          if (depth) {
+            /* clang-format off */
+            std::cerr <<
+              "error: unbalanced parentheses after '--castxml-cc-" <<
+              cc_id << "'\n"
+              "\n" <<
+              usage
+              ;
+            /* clang-format on */
+            return 1;
+          }
+          --i;
+        } else {
+          cc_args.push_back(argv[i]);
+        }
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: '--castxml-cc-<id>' may be given at most once!\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-E") == 0) {
+      opts.PPOnly = true;
+    } else if (strcmp(argv[i], "-o") == 0) {
+      if ((i + 1) < argc) {
+        opts.OutputFile = argv[++i];
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '-o' is missing (expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-help") == 0 ||
+               strcmp(argv[i], "--help") == 0) {
+      /* clang-format off */
+      std::cout <<
+        usage <<
+        "\n"
+        "Help for the internal Clang compiler appears below.\n"
+        "\n"
+        "---------------------------------------------------------------"
+        "\n" <<
+        std::endl;
+      /* clang-format on */
+      // Also print Clang help.
+      clang_args.push_back(argv[i]);
+    } else if (strcmp(argv[i], "--version") == 0) {
+      /* clang-format off */
+      std::cout <<
+        "castxml version " << getVersionString() << "\n"
+        "\n"
+        "CastXML project maintained and supported by Kitware "
+        "(kitware.com).\n" <<
+        std::endl;
+      /* clang-format on */
+      // Also print Clang version.
+      clang_args.push_back(argv[i]);
+    } else {
+      clang_args.push_back(argv[i]);
+      if (strcmp(argv[i], "-target") == 0 ||
+          strcmp(argv[i], "--target") == 0 ||
+          strncmp(argv[i], "-target=", 8) == 0 ||
+          strncmp(argv[i], "--target=", 9) == 0) {
+        opts.HaveTarget = true;
+      } else if (strncmp(argv[i], "-std=", 5) == 0) {
+        opts.HaveStd = true;
+      }
+    }
+  }
+
+  if (!opts.Targets.empty()) {
+    if (!opts.GccXml && !opts.CastXml) {
+      /* clang-format off */
+      std::cerr <<
+        "error: '--castxml-targets' requires '--castxml-gccxml' or"
+        " '--castxml-output=<v>'!\n"
+        "\n" <<
+        usage
+        ;
+      /* clang-format on */
+      return 1;
+    }
+    if (opts.OutputFile.empty() || opts.OutputFile == "-" || opts.Sink) {
+      /* clang-format off */
+      std::cerr <<
+        "error: '--castxml-targets' requires '-o <file>'!\n"
+        "\n" <<
+        usage
+        ;
+      /* clang-format on */
+      return 1;
+    }
+    if (opts.HaveTarget || !opts.Queries.empty() || !opts.EmitAST.empty() ||
+        !opts.IndexFile.empty() || !opts.Delta.empty()) {
+      /* clang-format off */
+      std::cerr <<
+        "error: '--castxml-targets' may not be used with '-target',"
+        " '--castxml-query', '--castxml-emit-ast', '--castxml-index',"
+        " or '--castxml-delta'!\n"
+        "\n" <<
+        usage
+        ;
+      /* clang-format on */
+      return 1;
+    }
+  }
+
+  if (cc_id) {
+    opts.HaveCC = true;
+    if (cc_args.empty()) {
+      /* clang-format off */
+      std::cerr <<
+        "error: '--castxml-cc-" << cc_id <<
+        "' must be followed by a compiler command!\n"
+        "\n" <<
+        usage
+        ;
+      /* clang-format on */
+      return 1;
+    }
+    // With '--castxml-targets' detection is done for each target.
+    if (opts.Targets.empty() &&
+        !detectCC(cc_id, cc_args.data(), cc_args.data() + cc_args.size(),
+                  opts)) {
+      return 1;
+    }
+  }
+
+  if (opts.GccXml && opts.CastXml) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-gccxml' and '--castxml-output=<v>'"
+      " may not be not be used together!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  if (!opts.EmitAST.empty() && !opts.GccXml && !opts.CastXml) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-emit-ast' requires '--castxml-gccxml' or"
+      " '--castxml-output=<v>'!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  if (!opts.ImplicitMemberReport.empty() && !opts.GccXml && !opts.CastXml) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-implicit-member-report' requires"
+      " '--castxml-gccxml' or '--castxml-output=<v>'!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  if (!opts.Delta.empty() && !opts.GccXml && !opts.CastXml) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-delta' requires '--castxml-gccxml' or"
+      " '--castxml-output=<v>'!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  if (opts.DependencyOrder && !opts.GccXml && !opts.CastXml) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-order=<v>' requires '--castxml-gccxml' or"
+      " '--castxml-output=<v>'!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  if (opts.DependencyOrder &&
+      (!opts.IndexFile.empty() || !opts.ShardBy.empty())) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-order=dependency' may not be used with"
+      " '--castxml-index' or '--castxml-shard-by=<v>'!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  if (!opts.IndexFile.empty() && !opts.GccXml && !opts.CastXml) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-index' requires '--castxml-gccxml' or"
+      " '--castxml-output=<v>'!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  if (!opts.IndexFile.empty() && (opts.Hashes || !opts.Delta.empty())) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-index' may not be used with '--castxml-hash'"
+      " or '--castxml-delta'!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  if (!opts.ShardBy.empty() && !opts.GccXml && !opts.CastXml) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-shard-by=<v>' requires '--castxml-gccxml' or"
+      " '--castxml-output=<v>'!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  if (!opts.ShardBy.empty() &&
+      (opts.Hashes || !opts.Delta.empty() || !opts.IndexFile.empty())) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-shard-by=<v>' may not be used with"
+      " '--castxml-hash', '--castxml-delta', or '--castxml-index'!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  // These options rewrite the output as XML text, which is never
+  // formatted for a sink.
+  if (opts.Sink &&
+      (opts.Hashes || opts.DependencyOrder || !opts.Delta.empty() ||
+       !opts.IndexFile.empty() || !opts.ShardBy.empty())) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-hash', '--castxml-order=dependency',"
+      " '--castxml-delta', '--castxml-index', and"
+      " '--castxml-shard-by=<v>' may not be used through libcastxml!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  if (!opts.Queries.empty() && !opts.GccXml && !opts.CastXml) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-query' requires '--castxml-gccxml' or"
+      " '--castxml-output=<v>'!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  if (!opts.UnityHeaders.empty() && !opts.GccXml && !opts.CastXml) {
+    /* clang-format off */
+    std::cerr <<
+      "error: '--castxml-unity' requires '--castxml-gccxml' or"
+      " '--castxml-output=<v>'!\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  // The unity source replaces this input, which selects the language
+  // unless given by '-x'.
+  std::string unity_input = opts.ResourceDir + "/empty.cpp";
+  if (!opts.UnityHeaders.empty()) {
+    clang_args.push_back(unity_input.c_str());
+  }
+
+  if (clang_args.empty()) {
+    return 0;
+  }
+
+  if (!opts.Targets.empty()) {
+    return runTargets(opts, cc_id, cc_args, clang_args);
+  }
+
+  return runClang(clang_args.data(), clang_args.data() + clang_args.size(),
+                  opts);
+}
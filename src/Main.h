@@ -0,0 +1,30 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#ifndef CASTXML_MAIN_H
+#define CASTXML_MAIN_H
+
+#include <string>
+
+class OutputSink;
+
+/// castxmlMain - Process command-line arguments as given to main(),
+/// including argv[0], and run.  Resources are found relative to the
+/// given castxml executable.  If a sink is given the main output is
+/// sent to it instead of to a file.  Returns the process exit code.
+int castxmlMain(int argc, char const* const* argv, std::string const& exe,
+                OutputSink* sink = nullptr);
+
+#endif // CASTXML_MAIN_H
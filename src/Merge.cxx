@@ -0,0 +1,702 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Merge.h"
+#include "XMLReader.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/MD5.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+
+// Attributes that do not contribute to the identity of an element.
+// They differ between complete and incomplete output of the same
+// declaration, or repeat information held by other attributes.
+bool isIdentityAttribute(std::string const& name)
+{
+  return !(name == "id" || name == "members" || name == "bases" ||
+           name == "befriending" || name == "overrides" ||
+           name == "comment" || name == "incomplete" || name == "size" ||
+           name == "align" || name == "abstract" || name == "location" ||
+           name == "hash");
+}
+
+// Split an element id into the id of its unqualified node and any
+// cv-qualifier suffix, e.g. "_12cv" into "_12" and "cv".
+void splitId(std::string const& id, std::string& base, std::string& suffix)
+{
+  std::string::size_type end = 1;
+  while (end < id.size() && id[end] >= '0' && id[end] <= '9') {
+    ++end;
+  }
+  base = id.substr(0, end);
+  suffix = id.substr(end);
+}
+
+typedef std::array<uint8_t, 16> Digest;
+
+Digest finalDigest(llvm::MD5& md5)
+{
+  llvm::MD5::MD5Result result;
+  md5.final(result);
+  Digest d;
+  for (size_t b = 0; b < d.size(); ++b) {
+    d[b] = result[b];
+  }
+  return d;
+}
+
+void updateDigest(llvm::MD5& md5, Digest const& d)
+{
+  md5.update(llvm::ArrayRef<uint8_t>(d.data(), d.size()));
+}
+
+class Merger
+{
+public:
+  Merger(std::ostream& out, std::ostream& error)
+    : Out(out)
+    , Error(error)
+  {
+  }
+
+  bool AddInput(std::string const& file);
+  void Finish();
+
+private:
+  // Per-input identity information for one element.  The identity
+  // text of the element is reduced to a digest as soon as it is read,
+  // so only a fixed amount of state plus its references is kept.
+  struct LocalNode
+  {
+    // Id of the element, pointing into the Index map key.
+    std::string const* Id = nullptr;
+    bool Defined = false;
+    // Digest of the identity attributes, not counting references.
+    Digest Local;
+    // References of the element in Refs, in order.
+    unsigned int RefBegin = 0;
+    unsigned int RefCount = 0;
+    // Depth-first order and lowest reachable order while computing
+    // strongly connected components, and whether on the SCC stack.
+    unsigned int Order = 0;
+    unsigned int Low = 0;
+    bool OnStack = false;
+    // Position in the component whose keys are being computed, if any.
+    bool InComponent = false;
+    unsigned int Slot = 0;
+    // Identity key of the element, and its new id.
+    Digest Key;
+    std::string NewId;
+  };
+
+  // A namespace whose members are merged from all inputs.
+  struct MergedNamespace
+  {
+    XMLElement Element;
+    std::vector<std::string> Members;
+    std::set<std::string> MemberSet;
+  };
+
+  bool ReadKeys(std::string const& file);
+  unsigned int GetNode(std::string const& id);
+  void ComputeKeys();
+  void ComputeComponentKeys(std::vector<unsigned int> const& component);
+  bool AssignIds();
+  bool WriteElements(std::string const& file);
+  bool Rename(XMLTag& tag);
+  bool RenameId(std::string& id);
+  void AddNamespaceMembers(MergedNamespace& ns, XMLElement const& element);
+  void AddKeyText(XMLTag const& tag, std::string& text);
+  bool Fail(std::string const& file, std::string const& msg);
+
+  std::ostream& Out;
+  std::ostream& Error;
+
+  // Document element of the first input.
+  XMLTag Root;
+  bool HaveRoot = false;
+
+  // Per-input state: identity of each element and its new id.
+  std::unordered_map<std::string, unsigned int> Index;
+  std::vector<LocalNode> Nodes;
+  std::vector<unsigned int> Refs;
+  std::vector<unsigned int> NodeOrder;
+  std::string CurrentError;
+
+  // Global state: new id of each identity key, and the last input
+  // that had an element with the key.
+  struct KeyId
+  {
+    std::string Id;
+    unsigned int Input = 0;
+  };
+  std::map<Digest, KeyId> Ids;
+  unsigned int InputCount = 0;
+
+  // Per-input count of elements sharing an identity key.
+  std::map<Digest, unsigned int> Duplicates;
+  unsigned int NextId = 0;
+  unsigned int NextFile = 0;
+  unsigned int NextComment = 0;
+
+  // Ids of elements already written.
+  std::set<std::string> Emitted;
+
+  // Elements held back until all inputs have been read.
+  std::map<std::string, MergedNamespace> Namespaces;
+  std::vector<std::string> NamespaceOrder;
+  std::map<std::string, XMLElement> Incomplete;
+  std::vector<std::string> IncompleteOrder;
+  std::vector<XMLElement> Files;
+};
+
+bool Merger::Fail(std::string const& file, std::string const& msg)
+{
+  this->Error << "error: " << file << ": " << msg << "\n";
+  return false;
+}
+
+bool Merger::AddInput(std::string const& file)
+{
+  // First pass: compute the identity of every element in this input.
+  // Second pass: write the elements not already seen in other inputs.
+  bool result = this->ReadKeys(file) &&
+    (this->AssignIds() || this->Fail(file, this->CurrentError)) &&
+    this->WriteElements(file);
+  this->Index.clear();
+  this->Nodes.clear();
+  this->Refs.clear();
+  this->NodeOrder.clear();
+  this->Duplicates.clear();
+  return result;
+}
+
+unsigned int Merger::GetNode(std::string const& id)
+{
+  auto inserted = this->Index.insert(
+    std::make_pair(id, static_cast<unsigned int>(this->Nodes.size())));
+  if (inserted.second) {
+    this->Nodes.emplace_back();
+    this->Nodes.back().Id = &inserted.first->first;
+  }
+  return inserted.first->second;
+}
+
+void Merger::AddKeyText(XMLTag const& tag, std::string& text)
+{
+  text += tag.Name;
+  for (auto const& a : tag.Attributes) {
+    if (!isIdentityAttribute(a.first)) {
+      continue;
+    }
+    text += ' ';
+    text += a.first;
+    text += '=';
+    switch (getXMLRefKind(a.first)) {
+      case XMLIdRef:
+        text += '#';
+        this->Refs.push_back(this->GetNode(a.second));
+        break;
+      case XMLIdListRef: {
+        std::istringstream tokens(a.second);
+        std::string token;
+        std::string prefix;
+        std::string id;
+        while (tokens >> token) {
+          splitXMLRefToken(token, prefix, id);
+          text += prefix;
+          text += "# ";
+          this->Refs.push_back(this->GetNode(id));
+        }
+      } break;
+      default:
+        text += a.second;
+        break;
+    }
+  }
+  text += '\n';
+}
+
+bool Merger::ReadKeys(std::string const& file)
+{
+  std::ifstream fin(file.c_str(), std::ios::in | std::ios::binary);
+  if (!fin) {
+    return this->Fail(file, "cannot open file");
+  }
+  XMLElementReader reader(fin);
+  std::string error;
+  XMLTag root;
+  if (!reader.readStart(root, error)) {
+    return this->Fail(file, error);
+  }
+  if (!this->HaveRoot) {
+    // Use the document element of the first input.
+    this->Root = root;
+    this->HaveRoot = true;
+    this->Out << "<?xml version=\"1.0\"?>\n";
+    writeXMLTag(this->Out, this->Root, 0);
+  } else if (root.Name != this->Root.Name) {
+    return this->Fail(file,
+                      "document element '" + root.Name +
+                        "' does not match '" + this->Root.Name +
+                        "' of the first input");
+  }
+
+  XMLElement element;
+  std::string text;
+  while (reader.readElement(element, error)) {
+    std::string id = element.getId();
+    if (id.empty()) {
+      return this->Fail(file, "element '" + element.Head.Name +
+                          "' has no id attribute");
+    }
+    unsigned int n = this->GetNode(id);
+    if (this->Nodes[n].Defined) {
+      return this->Fail(file, "duplicate id '" + id + "'");
+    }
+    this->NodeOrder.push_back(n);
+    unsigned int refBegin = static_cast<unsigned int>(this->Refs.size());
+    text.clear();
+    this->AddKeyText(element.Head, text);
+    for (XMLTag const& child : element.Children) {
+      // Base classes are listed only in complete class output.
+      if (child.Kind != XMLTag::Close && child.Name != "Base") {
+        this->AddKeyText(child, text);
+      }
+    }
+    LocalNode& node = this->Nodes[n];
+    node.Defined = true;
+    node.RefBegin = refBegin;
+    node.RefCount = static_cast<unsigned int>(this->Refs.size()) - refBegin;
+    llvm::MD5 md5;
+    md5.update(text);
+    node.Local = finalDigest(md5);
+  }
+  if (!error.empty()) {
+    return this->Fail(file, error);
+  }
+
+  for (LocalNode const& node : this->Nodes) {
+    if (!node.Defined) {
+      return this->Fail(file, "reference to undefined id '" + *node.Id + "'");
+    }
+  }
+  this->ComputeKeys();
+  return true;
+}
+
+void Merger::ComputeKeys()
+{
+  // Find the strongly connected components of the reference graph with
+  // an iterative form of Tarjan's algorithm.  Components complete after
+  // all components they refer to, so their keys can be computed then.
+  std::vector<std::pair<unsigned int, unsigned int>> frames;
+  std::vector<unsigned int> stack;
+  std::vector<unsigned int> component;
+  unsigned int order = 0;
+  for (unsigned int root : this->NodeOrder) {
+    if (this->Nodes[root].Order != 0) {
+      continue;
+    }
+    frames.emplace_back(root, 0);
+    this->Nodes[root].Order = this->Nodes[root].Low = ++order;
+    this->Nodes[root].OnStack = true;
+    stack.push_back(root);
+    while (!frames.empty()) {
+      unsigned int v = frames.back().first;
+      LocalNode& node = this->Nodes[v];
+      if (frames.back().second < node.RefCount) {
+        unsigned int w = this->Refs[node.RefBegin + frames.back().second++];
+        LocalNode& ref = this->Nodes[w];
+        if (ref.Order == 0) {
+          ref.Order = ref.Low = ++order;
+          ref.OnStack = true;
+          stack.push_back(w);
+          frames.emplace_back(w, 0);
+        } else if (ref.OnStack) {
+          node.Low = std::min(node.Low, ref.Order);
+        }
+        continue;
+      }
+      if (node.Low == node.Order) {
+        component.clear();
+        unsigned int w;
+        do {
+          w = stack.back();
+          stack.pop_back();
+          this->Nodes[w].OnStack = false;
+          component.push_back(w);
+        } while (w != v);
+        this->ComputeComponentKeys(component);
+      }
+      frames.pop_back();
+      if (!frames.empty()) {
+        LocalNode& parent = this->Nodes[frames.back().first];
+        parent.Low = std::min(parent.Low, node.Low);
+      }
+    }
+  }
+}
+
+void Merger::ComputeComponentKeys(std::vector<unsigned int> const& component)
+{
+  // Mark the members to tell references to them from references to
+  // earlier components, whose keys are known.
+  for (unsigned int i = 0; i < component.size(); ++i) {
+    this->Nodes[component[i]].InComponent = true;
+    this->Nodes[component[i]].Slot = i;
+  }
+  auto inComponent = [this](unsigned int n) -> bool {
+    return this->Nodes[n].InComponent;
+  };
+
+  // Start from the local identity and the keys of referenced elements
+  // outside the component.
+  std::vector<Digest> colors(component.size());
+  bool cyclic = component.size() > 1;
+  for (unsigned int i = 0; i < component.size(); ++i) {
+    LocalNode const& node = this->Nodes[component[i]];
+    llvm::MD5 md5;
+    updateDigest(md5, node.Local);
+    for (unsigned int r = 0; r < node.RefCount; ++r) {
+      unsigned int ref = this->Refs[node.RefBegin + r];
+      if (inComponent(ref)) {
+        md5.update("@");
+        cyclic = true;
+      } else {
+        updateDigest(md5, this->Nodes[ref].Key);
+      }
+    }
+    colors[i] = finalDigest(md5);
+  }
+
+  if (!cyclic) {
+    this->Nodes[component[0]].Key = colors[0];
+    this->Nodes[component[0]].InComponent = false;
+    return;
+  }
+
+  // Elements in a reference cycle are identified by the structure of
+  // the whole cycle rather than by where a traversal entered it, which
+  // differs between inputs.  Refine the digests by those of referenced
+  // members until no more members are told apart.  This depends only
+  // on the structure, not on the order of the elements.
+  auto countDistinct = [](std::vector<Digest> c) -> size_t {
+    std::sort(c.begin(), c.end());
+    return static_cast<size_t>(std::unique(c.begin(), c.end()) - c.begin());
+  };
+  size_t distinct = countDistinct(colors);
+  std::vector<Digest> next(component.size());
+  for (size_t round = 0; round < component.size(); ++round) {
+    for (unsigned int i = 0; i < component.size(); ++i) {
+      LocalNode const& node = this->Nodes[component[i]];
+      llvm::MD5 md5;
+      updateDigest(md5, colors[i]);
+      for (unsigned int r = 0; r < node.RefCount; ++r) {
+        unsigned int ref = this->Refs[node.RefBegin + r];
+        if (inComponent(ref)) {
+          updateDigest(md5, colors[this->Nodes[ref].Slot]);
+        }
+      }
+      next[i] = finalDigest(md5);
+    }
+    colors.swap(next);
+    size_t d = countDistinct(colors);
+    if (d == distinct) {
+      break;
+    }
+    distinct = d;
+  }
+
+  // Mix in the digests of all members so that keys reflect the whole
+  // component.
+  std::vector<Digest> sorted = colors;
+  std::sort(sorted.begin(), sorted.end());
+  llvm::MD5 md5;
+  for (Digest const& c : sorted) {
+    updateDigest(md5, c);
+  }
+  Digest whole = finalDigest(md5);
+  for (unsigned int i = 0; i < component.size(); ++i) {
+    llvm::MD5 key;
+    updateDigest(key, colors[i]);
+    updateDigest(key, whole);
+    this->Nodes[component[i]].Key = finalDigest(key);
+  }
+  for (unsigned int n : component) {
+    this->Nodes[n].InComponent = false;
+  }
+}
+
+bool Merger::AssignIds()
+{
+  // Number new nodes in the order they appear in the input.
+  ++this->InputCount;
+  std::string base;
+  std::string suffix;
+  for (unsigned int n : this->NodeOrder) {
+    LocalNode& node = this->Nodes[n];
+    std::string const& id = *node.Id;
+    splitId(id, base, suffix);
+    if (!suffix.empty()) {
+      continue;
+    }
+    KeyId* keyId = &this->Ids[node.Key];
+    if (keyId->Input == this->InputCount) {
+      // Another element of this input has the same identity, e.g. in a
+      // cycle of elements that cannot be told apart.  Keep them apart.
+      unsigned int count = ++this->Duplicates[node.Key];
+      llvm::MD5 md5;
+      updateDigest(md5, node.Key);
+      md5.update(std::to_string(count));
+      keyId = &this->Ids[finalDigest(md5)];
+    }
+    keyId->Input = this->InputCount;
+    std::string& newId = keyId->Id;
+    if (newId.empty()) {
+      switch (id[0]) {
+        case 'f':
+          // Keep the id reserved for compiler builtins.
+          newId = id == "f0" ? id : "f" + std::to_string(++this->NextFile);
+          break;
+        case 'c':
+          newId = "c" + std::to_string(++this->NextComment);
+          break;
+        default:
+          newId = "_" + std::to_string(++this->NextId);
+          break;
+      }
+    }
+    node.NewId = newId;
+  }
+
+  // Qualified type ids are derived from their unqualified type id.
+  for (unsigned int n : this->NodeOrder) {
+    LocalNode& node = this->Nodes[n];
+    splitId(*node.Id, base, suffix);
+    if (!suffix.empty()) {
+      std::unordered_map<std::string, unsigned int>::iterator i =
+        this->Index.find(base);
+      if (i == this->Index.end()) {
+        this->CurrentError = "reference to undefined id '" + base + "'";
+        return false;
+      }
+      node.NewId = this->Nodes[i->second].NewId + suffix;
+    }
+  }
+  return true;
+}
+
+bool Merger::RenameId(std::string& id)
+{
+  std::unordered_map<std::string, unsigned int>::iterator i =
+    this->Index.find(id);
+  if (i == this->Index.end()) {
+    this->CurrentError = "reference to undefined id '" + id + "'";
+    return false;
+  }
+  id = this->Nodes[i->second].NewId;
+  return true;
+}
+
+bool Merger::Rename(XMLTag& tag)
+{
+  for (auto& a : tag.Attributes) {
+    XMLRefKind kind = a.first == "id" ? XMLIdRef : getXMLRefKind(a.first);
+    switch (kind) {
+      case XMLIdRef:
+        if (!this->RenameId(a.second)) {
+          return false;
+        }
+        break;
+      case XMLIdListRef: {
+        std::istringstream tokens(a.second);
+        std::string token;
+        std::string prefix;
+        std::string id;
+        std::string value;
+        while (tokens >> token) {
+          splitXMLRefToken(token, prefix, id);
+          if (!this->RenameId(id)) {
+            return false;
+          }
+          if (!value.empty()) {
+            value += ' ';
+          }
+          value += prefix;
+          value += id;
+        }
+        a.second = value;
+      } break;
+      case XMLLocationRef: {
+        std::string::size_type colon = a.second.find(':');
+        std::string id = a.second.substr(0, colon);
+        if (!this->RenameId(id)) {
+          return false;
+        }
+        a.second.replace(0, colon, id);
+      } break;
+      default:
+        break;
+    }
+  }
+  return true;
+}
+
+void Merger::AddNamespaceMembers(MergedNamespace& ns,
+                                 XMLElement const& element)
+{
+  if (std::string const* members = element.Head.getAttribute("members")) {
+    std::istringstream tokens(*members);
+    std::string id;
+    while (tokens >> id) {
+      if (ns.MemberSet.insert(id).second) {
+        ns.Members.push_back(id);
+      }
+    }
+  }
+}
+
+bool Merger::WriteElements(std::string const& file)
+{
+  std::ifstream fin(file.c_str(), std::ios::in | std::ios::binary);
+  if (!fin) {
+    return this->Fail(file, "cannot open file");
+  }
+  XMLElementReader reader(fin);
+  std::string error;
+  XMLTag root;
+  if (!reader.readStart(root, error)) {
+    return this->Fail(file, error);
+  }
+
+  XMLElement element;
+  while (reader.readElement(element, error)) {
+    bool renamed = this->Rename(element.Head);
+    for (XMLTag& child : element.Children) {
+      renamed = renamed && this->Rename(child);
+    }
+    if (!renamed) {
+      return this->Fail(file, this->CurrentError);
+    }
+
+    std::string id = element.getId();
+    if (element.Head.Name == "Namespace") {
+      // Namespace members differ between inputs.  Write the union.
+      MergedNamespace& ns = this->Namespaces[id];
+      if (ns.Element.Head.Name.empty()) {
+        ns.Element = element;
+        ns.Element.Head.removeAttribute("members");
+        this->NamespaceOrder.push_back(id);
+      }
+      this->AddNamespaceMembers(ns, element);
+      continue;
+    }
+    if (!this->Emitted.insert(id).second) {
+      continue;
+    }
+    if (element.Head.Name == "File") {
+      this->Files.push_back(element);
+      continue;
+    }
+    std::string const* incomplete = element.Head.getAttribute("incomplete");
+    if (incomplete && *incomplete == "1") {
+      // Another input may have the complete declaration.
+      this->Emitted.erase(id);
+      if (this->Incomplete.insert(std::make_pair(id, element)).second) {
+        this->IncompleteOrder.push_back(id);
+      }
+      continue;
+    }
+    writeXMLElement(this->Out, element);
+    this->Incomplete.erase(id);
+  }
+  if (!error.empty()) {
+    return this->Fail(file, error);
+  }
+  return true;
+}
+
+void Merger::Finish()
+{
+  for (std::string const& id : this->NamespaceOrder) {
+    MergedNamespace& ns = this->Namespaces[id];
+    if (!ns.Members.empty()) {
+      // List members in id order as castxml does.
+      std::sort(ns.Members.begin(), ns.Members.end(),
+                [](std::string const& l, std::string const& r) {
+                  return l.size() < r.size() ||
+                    (l.size() == r.size() && l < r);
+                });
+      std::string members;
+      for (std::string const& m : ns.Members) {
+        if (!members.empty()) {
+          members += ' ';
+        }
+        members += m;
+      }
+      // Keep castxml's attribute order: members precedes the comment.
+      XMLTag::AttributeList& attrs = ns.Element.Head.Attributes;
+      XMLTag::AttributeList::iterator pos = attrs.end();
+      for (XMLTag::AttributeList::iterator i = attrs.begin();
+           i != attrs.end(); ++i) {
+        if (i->first == "comment") {
+          pos = i;
+          break;
+        }
+      }
+      attrs.insert(pos, std::make_pair(std::string("members"), members));
+    }
+    writeXMLElement(this->Out, ns.Element);
+  }
+  for (std::string const& id : this->IncompleteOrder) {
+    std::map<std::string, XMLElement>::iterator i = this->Incomplete.find(id);
+    if (i != this->Incomplete.end()) {
+      writeXMLElement(this->Out, i->second);
+    }
+  }
+  for (XMLElement const& f : this->Files) {
+    writeXMLElement(this->Out, f);
+  }
+  if (this->HaveRoot) {
+    this->Out << "</" << this->Root.Name << ">\n";
+  }
+}
+
+}
+
+bool mergeXML(std::vector<std::string> const& inputs, std::ostream& out,
+              std::ostream& error)
+{
+  Merger merger(out, error);
+  for (std::string const& input : inputs) {
+    if (!merger.AddInput(input)) {
+      return false;
+    }
+  }
+  merger.Finish();
+  return true;
+}
@@ -0,0 +1,29 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#ifndef CASTXML_MERGE_H
+#define CASTXML_MERGE_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/// mergeXML - Merge castxml output files into one document with one
+/// element per distinct declaration, type, comment, and file.
+/// On failure returns false and stores a message in the error stream.
+bool mergeXML(std::vector<std::string> const& inputs, std::ostream& out,
+              std::ostream& error);
+
+#endif // CASTXML_MERGE_H
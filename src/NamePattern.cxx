@@ -0,0 +1,156 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "NamePattern.h"
+
+#include <algorithm>
+
+NamePatternSet::NamePatternSet()
+  : Nodes(1)
+  , Patterns(0)
+{
+}
+
+void NamePatternSet::add(std::string const& pattern)
+{
+  std::vector<std::string> components = splitName(pattern);
+  if (components.empty()) {
+    return;
+  }
+
+  unsigned int cur = 0;
+  for (std::string const& c : components) {
+    unsigned int next = 0;
+    if (hasGlob(c)) {
+      for (auto const& g : this->Nodes[cur].Glob) {
+        if (g.first == c) {
+          next = g.second;
+          break;
+        }
+      }
+      if (!next) {
+        next = static_cast<unsigned int>(this->Nodes.size());
+        this->Nodes[cur].Glob.emplace_back(c, next);
+        this->Nodes.emplace_back();
+      }
+    } else {
+      unsigned int& n = this->Nodes[cur].Literal[c];
+      if (!n) {
+        n = static_cast<unsigned int>(this->Nodes.size());
+        this->Nodes.emplace_back();
+      }
+      next = n;
+    }
+    cur = next;
+  }
+  this->Nodes[cur].Final = true;
+  ++this->Patterns;
+}
+
+NamePatternSet::State NamePatternSet::start() const
+{
+  return State(1, 0);
+}
+
+NamePatternSet::State NamePatternSet::step(State const& s,
+                                           llvm::StringRef component) const
+{
+  State next;
+  for (unsigned int i : s) {
+    Node const& n = this->Nodes[i];
+    if (!n.Literal.empty()) {
+      auto l = n.Literal.find(component.str());
+      if (l != n.Literal.end()) {
+        next.push_back(l->second);
+      }
+    }
+    for (auto const& g : n.Glob) {
+      if (matchGlob(g.first, component)) {
+        next.push_back(g.second);
+      }
+    }
+  }
+  if (next.size() > 1) {
+    std::sort(next.begin(), next.end());
+    next.erase(std::unique(next.begin(), next.end()), next.end());
+  }
+  return next;
+}
+
+bool NamePatternSet::accepts(State const& s) const
+{
+  for (unsigned int i : s) {
+    if (this->Nodes[i].Final) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool NamePatternSet::hasGlob(llvm::StringRef component)
+{
+  return component.find_first_of("*?") != llvm::StringRef::npos;
+}
+
+bool NamePatternSet::matchGlob(llvm::StringRef glob, llvm::StringRef component)
+{
+  // Iterative matcher with single-star backtracking.
+  size_t g = 0;
+  size_t c = 0;
+  size_t star = llvm::StringRef::npos;
+  size_t mark = 0;
+  while (c < component.size()) {
+    if (g < glob.size() && glob[g] == '*') {
+      star = g++;
+      mark = c;
+    } else if (g < glob.size() &&
+               (glob[g] == '?' || glob[g] == component[c])) {
+      ++g;
+      ++c;
+    } else if (star != llvm::StringRef::npos) {
+      g = star + 1;
+      c = ++mark;
+    } else {
+      return false;
+    }
+  }
+  while (g < glob.size() && glob[g] == '*') {
+    ++g;
+  }
+  return g == glob.size();
+}
+
+std::vector<std::string> NamePatternSet::splitName(std::string const& name)
+{
+  std::vector<std::string> components;
+  std::string::size_type pos = 0;
+  // A leading "::" names the global scope explicitly.
+  if (name.compare(0, 2, "::") == 0) {
+    pos = 2;
+  }
+  if (pos >= name.size()) {
+    return components;
+  }
+  for (;;) {
+    std::string::size_type end = name.find("::", pos);
+    components.push_back(name.substr(pos, end - pos));
+    if (end == std::string::npos) {
+      break;
+    }
+    pos = end + 2;
+  }
+  return components;
+}
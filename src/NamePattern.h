@@ -0,0 +1,82 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#ifndef CASTXML_NAMEPATTERN_H
+#define CASTXML_NAMEPATTERN_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// NamePatternSet - A set of qualified name patterns compiled into an
+/// automaton over "::"-separated name components.  Each component of a
+/// pattern is either a literal name or a glob using '*' and '?'.
+///
+/// Matching consumes one name component per step, so callers walking
+/// nested declaration contexts can keep the State of each enclosing
+/// context and match a member with a single step.
+class NamePatternSet
+{
+public:
+  /// State - Sorted set of automaton nodes reached so far.
+  /// An empty state can never lead to a match.
+  typedef std::vector<unsigned int> State;
+
+  NamePatternSet();
+
+  /// add - Compile a qualified name pattern into the automaton.
+  void add(std::string const& pattern);
+
+  /// empty - Return true if no patterns have been added.
+  bool empty() const { return this->Patterns == 0; }
+
+  /// start - Get the state matching the global scope.
+  State start() const;
+
+  /// step - Get the state reached from the given state
+  /// after matching one more name component.
+  State step(State const& s, llvm::StringRef component) const;
+
+  /// accepts - Return true if the state matches a complete pattern.
+  bool accepts(State const& s) const;
+
+  /// hasGlob - Return true if the component uses glob syntax.
+  static bool hasGlob(llvm::StringRef component);
+
+  /// matchGlob - Match one name component against a glob.
+  static bool matchGlob(llvm::StringRef glob, llvm::StringRef component);
+
+  /// splitName - Split a qualified name into its components.
+  static std::vector<std::string> splitName(std::string const& name);
+
+private:
+  struct Node
+  {
+    Node()
+      : Final(false)
+    {
+    }
+    std::map<std::string, unsigned int> Literal;
+    std::vector<std::pair<std::string, unsigned int>> Glob;
+    bool Final;
+  };
+  std::vector<Node> Nodes;
+  unsigned int Patterns;
+};
+
+#endif // CASTXML_NAMEPATTERN_H
@@ -19,6 +19,8 @@
 #include <string>
 #include <vector>
 
+class OutputSink;
+
 struct Options
 {
   Options()
@@ -28,7 +30,19 @@ struct Options
     , HaveCC(false)
     , HaveStd(false)
     , HaveTarget(false)
+    , SkipFunctionBodies(false)
+    , StableIds(false)
+    , Hashes(false)
+    , DependencyOrder(false)
+    , ReferencedSpecializations(false)
+    , LocationColumns(false)
+    , HaveImplicitMemberBudget(false)
     , CastXmlEpicFormatVersion(1)
+    , MaxRSS(0)
+    , ImplicitMemberDepth(16)
+    , ImplicitMemberClasses(~0u)
+    , ImplicitMemberTime(~0u)
+    , Sink(nullptr)
   {
   }
   bool PPOnly;
@@ -37,7 +51,22 @@ struct Options
   bool HaveCC;
   bool HaveStd;
   bool HaveTarget;
+  bool SkipFunctionBodies;
+  bool StableIds;
+  bool Hashes;
+  bool DependencyOrder;
+  bool ReferencedSpecializations;
+  bool LocationColumns;
+  bool HaveImplicitMemberBudget;
   unsigned int CastXmlEpicFormatVersion;
+  // Resident set size limit in MiB, or 0 for no limit.
+  unsigned long long MaxRSS;
+  // Budget for forcing implicit class members: nesting depth of the
+  // classes they define, number of classes, and time in milliseconds.
+  unsigned int ImplicitMemberDepth;
+  unsigned int ImplicitMemberClasses;
+  unsigned int ImplicitMemberTime;
+  std::string ImplicitMemberReport;
   struct Include
   {
     Include(std::string const& d, bool f = false)
@@ -53,6 +82,38 @@ struct Options
   std::string Predefines;
   std::string Triple;
   std::vector<std::string> StartNames;
+  std::vector<std::string> ExcludeNames;
+  std::vector<std::string> UnityHeaders;
+  std::vector<std::string> Targets;
+  struct Query
+  {
+    Query(std::string const& f)
+      : OutputFile(f)
+    {
+    }
+    std::string OutputFile;
+    std::vector<std::string> StartNames;
+  };
+  std::vector<Query> Queries;
+  struct VirtualFile
+  {
+    VirtualFile(std::string const& p, std::string const& c)
+      : Path(p)
+      , Contents(c)
+    {
+    }
+    std::string Path;
+    std::string Contents;
+  };
+  std::vector<VirtualFile> VirtualFiles;
+  std::string EmitAST;
+  std::string Delta;
+  std::string IndexFile;
+  std::string ShardBy;
+  std::string ResourceDir;
+  std::string ClangResourceDir;
+  // If not null, the main output is sent here instead of to a file.
+  OutputSink* Sink;
 };
 
 #endif // CASTXML_OPTIONS_H
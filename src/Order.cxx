@@ -0,0 +1,272 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Order.h"
+#include "XMLReader.h"
+
+#include <algorithm>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// References through these attributes point from an element to
+// elements that refer back to it, such as its members.  They do not
+// constrain the order, so that such pairs do not form cycles.
+bool isBackRef(std::string const& name)
+{
+  return name == "members" || name == "attached" || name == "befriending";
+}
+
+// References from these elements name a type that need not be
+// complete, so a cycle through them may be broken there.
+bool isIndirectType(std::string const& name)
+{
+  return name == "PointerType" || name == "ReferenceType" ||
+    name == "RValueReferenceType";
+}
+
+class Orderer
+{
+public:
+  bool Read(std::string const& xml, std::string& error);
+  void Write(std::ostream& out);
+
+private:
+  struct Ref
+  {
+    size_t Target;
+    // Whether the reference may refer forward to break a cycle.
+    bool Weak;
+  };
+
+  struct Node
+  {
+    XMLElement Element;
+    std::vector<Ref> Refs;
+    bool Incomplete = false;
+    // Tarjan's strongly connected components algorithm state.
+    unsigned int Order = 0;
+    unsigned int Low = 0;
+    bool OnStack = false;
+    // Component being written and the state of the node within it.
+    unsigned int Component = 0;
+    enum
+    {
+      New,
+      Active,
+      Done
+    } State = New;
+  };
+
+  void AddRefs(XMLTag const& tag, std::vector<std::string>& refs);
+  void WriteComponent(std::vector<size_t>& component, std::ostream& out);
+
+  XMLTag Root;
+  std::vector<Node> Nodes;
+  unsigned int ComponentCount = 0;
+};
+
+void Orderer::AddRefs(XMLTag const& tag, std::vector<std::string>& refs)
+{
+  for (auto const& a : tag.Attributes) {
+    if (isBackRef(a.first)) {
+      continue;
+    }
+    switch (getXMLRefKind(a.first)) {
+      case XMLIdRef:
+        refs.push_back(a.second);
+        break;
+      case XMLIdListRef: {
+        std::istringstream tokens(a.second);
+        std::string token;
+        std::string prefix;
+        std::string id;
+        while (tokens >> token) {
+          splitXMLRefToken(token, prefix, id);
+          refs.push_back(id);
+        }
+      } break;
+      case XMLLocationRef:
+        refs.push_back(a.second.substr(0, a.second.find(':')));
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+bool Orderer::Read(std::string const& xml, std::string& error)
+{
+  std::istringstream in(xml);
+  XMLElementReader reader(in);
+  if (!reader.readStart(this->Root, error)) {
+    return false;
+  }
+
+  std::vector<std::vector<std::string>> refs;
+  std::map<std::string, size_t> index;
+  XMLElement element;
+  while (reader.readElement(element, error)) {
+    index[element.getId()] = this->Nodes.size();
+    refs.emplace_back();
+    this->AddRefs(element.Head, refs.back());
+    for (XMLTag const& child : element.Children) {
+      this->AddRefs(child, refs.back());
+    }
+    this->Nodes.emplace_back();
+    Node& node = this->Nodes.back();
+    std::string const* incomplete = element.Head.getAttribute("incomplete");
+    node.Incomplete = incomplete && *incomplete == "1";
+    node.Element = std::move(element);
+  }
+  if (!error.empty()) {
+    return false;
+  }
+
+  // Resolve references now that every element has an index.
+  for (size_t n = 0; n < this->Nodes.size(); ++n) {
+    bool indirect = isIndirectType(this->Nodes[n].Element.Head.Name);
+    for (std::string const& id : refs[n]) {
+      auto i = index.find(id);
+      if (i != index.end()) {
+        bool weak = indirect || this->Nodes[i->second].Incomplete;
+        this->Nodes[n].Refs.push_back({ i->second, weak });
+      }
+    }
+  }
+  return true;
+}
+
+void Orderer::Write(std::ostream& out)
+{
+  out << "<?xml version=\"1.0\"?>\n";
+  writeXMLTag(out, this->Root, 0);
+
+  // Find the strongly connected components of the reference graph
+  // with an iterative form of Tarjan's algorithm.  Components complete
+  // after all components they refer to, so each may be written then.
+  // Start from each element in the original order so that unrelated
+  // elements keep their relative order.
+  std::vector<std::pair<size_t, size_t>> frames;
+  std::vector<size_t> stack;
+  std::vector<size_t> component;
+  unsigned int order = 0;
+  for (size_t root = 0; root < this->Nodes.size(); ++root) {
+    if (this->Nodes[root].Order != 0) {
+      continue;
+    }
+    this->Nodes[root].Order = this->Nodes[root].Low = ++order;
+    this->Nodes[root].OnStack = true;
+    stack.push_back(root);
+    frames.emplace_back(root, 0);
+    while (!frames.empty()) {
+      size_t v = frames.back().first;
+      Node& node = this->Nodes[v];
+      if (frames.back().second < node.Refs.size()) {
+        size_t w = node.Refs[frames.back().second++].Target;
+        Node& target = this->Nodes[w];
+        if (target.Order == 0) {
+          target.Order = target.Low = ++order;
+          target.OnStack = true;
+          stack.push_back(w);
+          frames.emplace_back(w, 0);
+        } else if (target.OnStack) {
+          node.Low = std::min(node.Low, target.Order);
+        }
+        continue;
+      }
+      if (node.Low == node.Order) {
+        component.clear();
+        size_t w;
+        do {
+          w = stack.back();
+          stack.pop_back();
+          this->Nodes[w].OnStack = false;
+          component.push_back(w);
+        } while (w != v);
+        this->WriteComponent(component, out);
+      }
+      frames.pop_back();
+      if (!frames.empty()) {
+        Node& parent = this->Nodes[frames.back().first];
+        parent.Low = std::min(parent.Low, node.Low);
+      }
+    }
+  }
+
+  out << "</" << this->Root.Name << ">\n";
+}
+
+void Orderer::WriteComponent(std::vector<size_t>& component,
+                             std::ostream& out)
+{
+  if (component.size() == 1) {
+    writeXMLElement(out, this->Nodes[component[0]].Element);
+    return;
+  }
+
+  // Order the elements of a cycle by their references other than
+  // those through pointer and reference types or to incomplete
+  // declarations, which are left to refer forward.  Should those
+  // references still form a cycle, break it at the first element
+  // reached again when visiting elements in the original order.
+  unsigned int id = ++this->ComponentCount;
+  for (size_t n : component) {
+    this->Nodes[n].Component = id;
+  }
+  std::sort(component.begin(), component.end());
+  std::vector<std::pair<size_t, size_t>> frames;
+  for (size_t root : component) {
+    if (this->Nodes[root].State != Node::New) {
+      continue;
+    }
+    this->Nodes[root].State = Node::Active;
+    frames.emplace_back(root, 0);
+    while (!frames.empty()) {
+      Node& node = this->Nodes[frames.back().first];
+      if (frames.back().second < node.Refs.size()) {
+        Ref const& ref = node.Refs[frames.back().second++];
+        Node& target = this->Nodes[ref.Target];
+        if (!ref.Weak && target.Component == id &&
+            target.State == Node::New) {
+          target.State = Node::Active;
+          frames.emplace_back(ref.Target, 0);
+        }
+        continue;
+      }
+      node.State = Node::Done;
+      writeXMLElement(out, node.Element);
+      frames.pop_back();
+    }
+  }
+}
+
+}
+
+bool writeXMLInDependencyOrder(std::string const& xml, std::ostream& out,
+                               std::string& error)
+{
+  Orderer orderer;
+  if (!orderer.Read(xml, error)) {
+    return false;
+  }
+  orderer.Write(out);
+  return true;
+}
@@ -0,0 +1,30 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#ifndef CASTXML_ORDER_H
+#define CASTXML_ORDER_H
+
+#include <iosfwd>
+#include <string>
+
+/// writeXMLInDependencyOrder - Write castxml output with its elements
+/// reordered so that each element follows the elements it references,
+/// except through references to members or attached comments and
+/// references that close a cycle.
+/// On failure returns false and stores a message.
+bool writeXMLInDependencyOrder(std::string const& xml, std::ostream& out,
+                               std::string& error);
+
+#endif // CASTXML_ORDER_H
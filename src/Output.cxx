@@ -15,7 +15,9 @@
 */
 
 #include "Output.h"
+#include "NamePattern.h"
 #include "Options.h"
+#include "Unity.h"
 #include "Utils.h"
 
 #include "llvm/Config/llvm-config.h"
@@ -39,15 +41,30 @@
 #include "clang/Basic/Specifiers.h"
 #include "clang/Basic/TargetInfo.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendDiagnostic.h"
 #include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/StringSaver.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
 #include <queue>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #if LLVM_VERSION_MAJOR >= 21
@@ -123,19 +140,683 @@ clang::NestedNameSpecifier const& deref(NestedNameSpecifier const& nns)
 #  define getRawCommentNoCache getRawCommentForDeclNoCache
 #endif
 
+// Standard allocator drawing from a bump pointer arena.  Deallocation
+// is a no-op; the memory is released all at once with the arena.  This
+// lets the node-based containers of one output pass touch the global
+// heap only once per slab.
+template <typename T>
+class ArenaAllocator
+{
+  template <typename U>
+  friend class ArenaAllocator;
+  llvm::BumpPtrAllocator* Arena;
+
+public:
+  typedef T value_type;
+
+  ArenaAllocator(llvm::BumpPtrAllocator& arena)
+    : Arena(&arena)
+  {
+  }
+  template <typename U>
+  ArenaAllocator(ArenaAllocator<U> const& other)
+    : Arena(other.Arena)
+  {
+  }
+
+  T* allocate(std::size_t n)
+  {
+    return static_cast<T*>(
+      this->Arena->Allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, std::size_t) {}
+
+  friend bool operator==(ArenaAllocator const& l, ArenaAllocator const& r)
+  {
+    return l.Arena == r.Arena;
+  }
+  friend bool operator!=(ArenaAllocator const& l, ArenaAllocator const& r)
+  {
+    return l.Arena != r.Arena;
+  }
+};
+
+// Ordered map and set types whose nodes live in an arena.
+template <typename K, typename V, typename C = std::less<K>>
+using ArenaMap = std::map<K, V, C, ArenaAllocator<std::pair<K const, V>>>;
+template <typename K, typename C = std::less<K>>
+using ArenaSet = std::set<K, C, ArenaAllocator<K>>;
+
+// Stream that forwards output to one of several shard files, opened
+// on first use.  Text written before the first shard is selected is
+// kept as a header for every shard, and text written after finishing
+// the elements is kept as a footer for every shard.
+class ShardWriter : public llvm::raw_ostream
+{
+  struct Shard
+  {
+    std::string Name;
+    std::string File;
+    std::unique_ptr<llvm::raw_ostream> OS;
+  };
+
+  clang::CompilerInstance& CI;
+  std::string Base;
+  std::vector<Shard> Shards;
+  std::map<std::string, unsigned int> ShardIndex;
+  llvm::raw_ostream* Target = nullptr;
+  std::string* Capture;
+  std::string Header;
+  std::string Footer;
+  uint64_t Pos = 0;
+
+  void write_impl(char const* ptr, size_t size) override
+  {
+    if (this->Target) {
+      this->Target->write(ptr, size);
+    } else if (this->Capture) {
+      this->Capture->append(ptr, size);
+    }
+    this->Pos += size;
+  }
+
+  uint64_t current_pos() const override { return this->Pos; }
+
+public:
+  ShardWriter(clang::CompilerInstance& ci, std::string const& base)
+    : llvm::raw_ostream(true)
+    , CI(ci)
+    , Base(base)
+    , Capture(&this->Header)
+  {
+    // Shard 0 holds global declarations and elements not owned by
+    // any other shard.
+    this->GetShard("::");
+  }
+
+  /** Get the index of a shard by name, adding it if needed.  */
+  unsigned int GetShard(std::string const& name)
+  {
+    auto i = this->ShardIndex.find(name);
+    if (i != this->ShardIndex.end()) {
+      return i->second;
+    }
+    unsigned int index = static_cast<unsigned int>(this->Shards.size());
+    this->ShardIndex[name] = index;
+    Shard shard;
+    shard.Name = name;
+    llvm::SmallString<128> file(this->Base);
+    llvm::sys::path::replace_extension(file,
+                                       std::to_string(index) + ".xml");
+    shard.File = std::string(file.str());
+    this->Shards.push_back(std::move(shard));
+    return index;
+  }
+
+  /** Direct output to the given shard, opening its file if needed.  */
+  void Select(unsigned int index)
+  {
+    Shard& shard = this->Shards[index];
+    if (!shard.OS) {
+      std::error_code ec;
+      shard.OS.reset(new llvm::raw_fd_ostream(shard.File, ec,
+#if LLVM_VERSION_MAJOR >= 9
+                                              llvm::sys::fs::OF_None
+#else
+                                              llvm::sys::fs::F_None
+#endif
+                                              ));
+      if (ec) {
+        clang::DiagnosticsEngine& diags = this->CI.getDiagnostics();
+        diags.setSuppressAllDiagnostics(false);
+        diags.Report(clang::diag::err_fe_unable_to_open_output)
+          << shard.File << ec.message();
+        shard.OS.reset(new llvm::raw_null_ostream);
+      }
+      *shard.OS << this->Header;
+    }
+    this->Target = shard.OS.get();
+  }
+
+  /** Stop capturing the header.  */
+  void EndHeader() { this->Capture = nullptr; }
+
+  /** Capture the footer written after the last element.  */
+  void BeginFooter()
+  {
+    this->Target = nullptr;
+    this->Capture = &this->Footer;
+  }
+
+  /** Finish every shard and write the manifest listing them.  */
+  void Finish(llvm::raw_ostream& manifest, std::string const& by)
+  {
+    /* clang-format off */
+    manifest <<
+      "<?xml version=\"1.0\"?>\n"
+      "<Shards by=\"" << by << "\">\n"
+      ;
+    /* clang-format on */
+    for (Shard& shard : this->Shards) {
+      if (!shard.OS) {
+        continue;
+      }
+      *shard.OS << this->Footer;
+      shard.OS.reset();
+      /* clang-format off */
+      manifest <<
+        "  <Shard"
+        " name=\"" << encodeXML(shard.Name) << "\""
+        " file=\"" << encodeXML(llvm::sys::path::filename(shard.File).str())
+                   << "\""
+        "/>\n"
+        ;
+      /* clang-format on */
+    }
+    manifest << "</Shards>\n";
+  }
+};
+
+// Stream that holds each element until the hashes of the elements it
+// references are known, and then writes it with a hash attribute after
+// its id.  The XML writer marks ids and references as it prints them,
+// so the hash of an element covers its text with ids replaced by
+// placeholders, plus the hashes of the elements it references.
+class HashWriter : public llvm::raw_ostream
+{
+  struct Span
+  {
+    size_t Begin;
+    size_t End;
+  };
+
+  struct Element
+  {
+    std::string Text;
+    // Extent of the id value, which is followed by its closing quote.
+    size_t IdBegin = 0;
+    size_t IdEnd = 0;
+    std::vector<Span> Refs;
+    std::vector<unsigned int> Targets;
+    // Hash of the text with ids replaced by placeholders.
+    uint64_t Local = 0;
+    uint64_t Full = 0;
+    // Tarjan's strongly connected components algorithm state.
+    unsigned int Order = 0;
+    unsigned int Low = 0;
+    bool OnStack = false;
+    unsigned int Component = 0;
+  };
+
+  static unsigned int const Missing = ~0u;
+
+  llvm::raw_ostream& OS;
+  std::vector<Element> Elements;
+  bool Holding = false;
+  bool InElement = false;
+  size_t RefBegin = 0;
+  unsigned int ComponentCount = 0;
+  uint64_t Pos = 0;
+
+  void write_impl(char const* ptr, size_t size) override
+  {
+    if (this->Holding) {
+      if (!this->InElement) {
+        this->Elements.emplace_back();
+        this->InElement = true;
+      }
+      this->Elements.back().Text.append(ptr, size);
+    } else {
+      this->OS.write(ptr, size);
+    }
+    this->Pos += size;
+  }
+
+  uint64_t current_pos() const override { return this->Pos; }
+
+  size_t TextSize() const
+  {
+    return this->InElement ? this->Elements.back().Text.size() : 0;
+  }
+
+  static uint64_t FinalHash(llvm::MD5& md5)
+  {
+    llvm::MD5::MD5Result digest;
+    md5.final(digest);
+    uint64_t h = 0;
+    for (size_t b = 0; b < 8; ++b) {
+      h = (h << 8) | digest[b];
+    }
+    return h;
+  }
+
+  static void UpdateHash(llvm::MD5& md5, uint64_t h)
+  {
+    uint8_t bytes[8];
+    for (size_t b = 0; b < 8; ++b) {
+      bytes[b] = static_cast<uint8_t>(h >> (56 - 8 * b));
+    }
+    md5.update(llvm::ArrayRef<uint8_t>(bytes, 8));
+  }
+
+  uint64_t RefHash(unsigned int node, unsigned int component) const
+  {
+    if (node == Missing) {
+      return 0;
+    }
+    Element const& e = this->Elements[node];
+    if (e.Component == component) {
+      return e.Local;
+    }
+    // Components are finished after all components they reference.
+    return e.Full;
+  }
+
+  void ResolveRefs()
+  {
+    std::unordered_map<std::string, unsigned int> ids;
+    for (unsigned int i = 0; i < this->Elements.size(); ++i) {
+      Element const& e = this->Elements[i];
+      ids[e.Text.substr(e.IdBegin, e.IdEnd - e.IdBegin)] = i;
+    }
+    for (Element& e : this->Elements) {
+      e.Targets.reserve(e.Refs.size());
+      for (Span const& r : e.Refs) {
+        auto i = ids.find(e.Text.substr(r.Begin, r.End - r.Begin));
+        unsigned int node = Missing;
+        if (i != ids.end()) {
+          node = i->second;
+        }
+        e.Targets.push_back(node);
+      }
+      std::vector<Span>().swap(e.Refs);
+    }
+  }
+
+  void ComputeHashes()
+  {
+    // Find the strongly connected components of the reference graph
+    // with an iterative form of Tarjan's algorithm.  Scopes and their
+    // members reference each other, so each scope forms a cycle with
+    // everything declared in it.
+    std::vector<std::pair<unsigned int, size_t>> frames;
+    std::vector<unsigned int> stack;
+    std::vector<unsigned int> component;
+    unsigned int order = 0;
+    for (unsigned int root = 0; root < this->Elements.size(); ++root) {
+      if (this->Elements[root].Order != 0) {
+        continue;
+      }
+      this->Elements[root].Order = this->Elements[root].Low = ++order;
+      this->Elements[root].OnStack = true;
+      stack.push_back(root);
+      frames.emplace_back(root, 0);
+      while (!frames.empty()) {
+        unsigned int v = frames.back().first;
+        Element& e = this->Elements[v];
+        if (frames.back().second < e.Targets.size()) {
+          unsigned int t = e.Targets[frames.back().second++];
+          if (t == Missing) {
+            continue;
+          }
+          Element& ref = this->Elements[t];
+          if (ref.Order == 0) {
+            ref.Order = ref.Low = ++order;
+            ref.OnStack = true;
+            stack.push_back(t);
+            frames.emplace_back(t, 0);
+          } else if (ref.OnStack) {
+            e.Low = std::min(e.Low, ref.Order);
+          }
+          continue;
+        }
+        if (e.Low == e.Order) {
+          component.clear();
+          unsigned int w;
+          do {
+            w = stack.back();
+            stack.pop_back();
+            this->Elements[w].OnStack = false;
+            component.push_back(w);
+          } while (w != v);
+          this->FinishComponent(component);
+        }
+        frames.pop_back();
+        if (!frames.empty()) {
+          Element& parent = this->Elements[frames.back().first];
+          parent.Low = std::min(parent.Low, e.Low);
+        }
+      }
+    }
+  }
+
+  void FinishComponent(std::vector<unsigned int> const& component)
+  {
+    unsigned int id = ++this->ComponentCount;
+    for (unsigned int n : component) {
+      this->Elements[n].Component = id;
+    }
+
+    // Hash each element with references inside its component replaced
+    // by their local hashes.  This does not depend on where the
+    // traversal entered the cycle.
+    for (unsigned int n : component) {
+      Element& e = this->Elements[n];
+      llvm::MD5 md5;
+      UpdateHash(md5, e.Local);
+      for (unsigned int t : e.Targets) {
+        UpdateHash(md5, this->RefHash(t, id));
+      }
+      e.Full = FinalHash(md5);
+    }
+    if (component.size() < 2) {
+      return;
+    }
+
+    // Combine the sorted hashes of all elements of a cycle so that a
+    // change to any of them changes the hash of every one.
+    std::vector<uint64_t> hashes;
+    for (unsigned int n : component) {
+      hashes.push_back(this->Elements[n].Full);
+    }
+    std::sort(hashes.begin(), hashes.end());
+    llvm::MD5 md5;
+    for (uint64_t h : hashes) {
+      UpdateHash(md5, h);
+    }
+    uint64_t combined = FinalHash(md5);
+    for (unsigned int n : component) {
+      Element& e = this->Elements[n];
+      llvm::MD5 emd5;
+      UpdateHash(emd5, e.Full);
+      UpdateHash(emd5, combined);
+      e.Full = FinalHash(emd5);
+    }
+  }
+
+public:
+  HashWriter(llvm::raw_ostream& os)
+    : llvm::raw_ostream(true)
+    , OS(os)
+  {
+  }
+
+  /** Hold elements written after the header.  */
+  void EndHeader() { this->Holding = true; }
+
+  /** Mark the start of an id or reference.  */
+  void BeginRef() { this->RefBegin = this->TextSize(); }
+
+  /** Mark the end of a reference to another element.  */
+  void EndRef()
+  {
+    if (this->InElement) {
+      this->Elements.back().Refs.push_back(
+        { this->RefBegin, this->TextSize() });
+    }
+  }
+
+  /** Mark the end of the id of the element being written.  */
+  void EndId()
+  {
+    if (this->InElement) {
+      Element& e = this->Elements.back();
+      e.IdBegin = this->RefBegin;
+      e.IdEnd = this->TextSize();
+    }
+  }
+
+  /** Finish the element being written and compute its local hash.  */
+  void EndElement()
+  {
+    if (!this->InElement) {
+      return;
+    }
+    this->InElement = false;
+    Element& e = this->Elements.back();
+    std::vector<Span> spans = e.Refs;
+    spans.push_back({ e.IdBegin, e.IdEnd });
+    std::sort(spans.begin(), spans.end(),
+              [](Span const& l, Span const& r) { return l.Begin < r.Begin; });
+    llvm::MD5 md5;
+    size_t pos = 0;
+    for (Span const& s : spans) {
+      md5.update(llvm::StringRef(e.Text).slice(pos, s.Begin));
+      md5.update("#");
+      pos = s.End;
+    }
+    md5.update(llvm::StringRef(e.Text).substr(pos));
+    e.Local = FinalHash(md5);
+  }
+
+  /** Write the held elements with their hashes.  */
+  void Finish()
+  {
+    this->Holding = false;
+    this->ResolveRefs();
+    this->ComputeHashes();
+    static char const hex[] = "0123456789abcdef";
+    for (Element& e : this->Elements) {
+      char digits[16];
+      for (size_t d = 0; d < 16; ++d) {
+        digits[d] = hex[(e.Full >> (60 - 4 * d)) & 0xF];
+      }
+      size_t split = e.IdEnd + 1;
+      this->OS << llvm::StringRef(e.Text).substr(0, split) << " hash=\""
+               << llvm::StringRef(digits, 16) << "\""
+               << llvm::StringRef(e.Text).substr(split);
+      std::string().swap(e.Text);
+    }
+    this->Elements.clear();
+  }
+};
+
+// Sink that prints the elements as XML.  It marks ids and references
+// for the hash writer, if any, and writes the byte range of each
+// element to the index, if any.
+class XMLWriter : public OutputSink
+{
+  struct OpenElement
+  {
+    llvm::StringRef Name;
+    bool HasChildren;
+  };
+
+  llvm::raw_ostream& OS;
+  ShardWriter* Shards;
+  HashWriter* Hashes;
+  llvm::raw_ostream* Index;
+  llvm::StringRef Document;
+  std::vector<OpenElement> Elements;
+  std::string ElementId;
+  uint64_t ElementBegin = 0;
+
+public:
+  XMLWriter(llvm::raw_ostream& os, ShardWriter* shards, HashWriter* hashes,
+            llvm::raw_ostream* index)
+    : OS(os)
+    , Shards(shards)
+    , Hashes(hashes)
+    , Index(index)
+  {
+  }
+
+  void BeginDocument(
+    llvm::StringRef name,
+    llvm::ArrayRef<std::pair<llvm::StringRef, llvm::StringRef>> attributes)
+    override
+  {
+    this->Document = name;
+    this->OS << "<?xml version=\"1.0\"?>\n<" << name;
+    for (auto const& a : attributes) {
+      this->OS << ' ' << a.first << "=\"" << encodeXML(a.second.str())
+               << '"';
+    }
+    this->OS << ">\n";
+    if (this->Shards) {
+      this->Shards->EndHeader();
+    }
+    if (this->Hashes) {
+      this->Hashes->EndHeader();
+    }
+  }
+
+  void EndDocument() override
+  {
+    if (this->Shards) {
+      this->Shards->BeginFooter();
+    }
+    if (this->Hashes) {
+      this->Hashes->Finish();
+    }
+    this->OS << "</" << this->Document << ">\n";
+  }
+
+  void BeginElement(llvm::StringRef name) override
+  {
+    if (this->Elements.empty()) {
+      this->ElementBegin = this->OS.tell();
+      this->ElementId.clear();
+    } else if (!this->Elements.back().HasChildren) {
+      this->OS << ">\n";
+      this->Elements.back().HasChildren = true;
+    }
+    this->OS.indent(2 * (this->Elements.size() + 1)) << '<' << name;
+    this->Elements.push_back({ name, false });
+  }
+
+  void EndElement() override
+  {
+    OpenElement e = this->Elements.back();
+    this->Elements.pop_back();
+    if (e.HasChildren) {
+      this->OS.indent(2 * (this->Elements.size() + 1))
+        << "</" << e.Name << ">\n";
+    } else {
+      this->OS << "/>\n";
+    }
+    if (!this->Elements.empty()) {
+      return;
+    }
+    if (this->Hashes) {
+      this->Hashes->EndElement();
+    }
+    if (this->Index) {
+      uint64_t end = this->OS.tell();
+      *this->Index << "element " << this->ElementId << ' '
+                   << this->ElementBegin << ' '
+                   << (end - this->ElementBegin) << '\n';
+    }
+  }
+
+  void BeginAttribute(llvm::StringRef name) override
+  {
+    this->OS << ' ' << name << "=\"";
+  }
+
+  void EndAttribute() override { this->OS << '"'; }
+
+  void Text(llvm::StringRef text) override
+  {
+    // Write newlines as references so that attribute value
+    // normalization does not turn them into spaces.
+    for (;;) {
+      size_t nl = text.find('\n');
+      this->OS << encodeXML(text.substr(0, nl).str());
+      if (nl == llvm::StringRef::npos) {
+        break;
+      }
+      this->OS << "&#xA;";
+      text = text.substr(nl + 1);
+    }
+  }
+
+  void Id(llvm::StringRef id) override
+  {
+    if (this->Elements.size() == 1) {
+      this->ElementId = id.str();
+    }
+    if (this->Hashes) {
+      this->Hashes->BeginRef();
+    }
+    this->OS << id;
+    if (this->Hashes) {
+      this->Hashes->EndId();
+    }
+  }
+
+  void Ref(llvm::StringRef id) override
+  {
+    if (this->Hashes) {
+      this->Hashes->BeginRef();
+    }
+    this->OS << id;
+    if (this->Hashes) {
+      this->Hashes->EndRef();
+    }
+  }
+};
+
 class ASTVisitorBase
 {
 protected:
   clang::CompilerInstance& CI;
   clang::ASTContext const& CTX;
-  llvm::raw_ostream& OS;
+  OutputSink& Out;
 
   ASTVisitorBase(clang::CompilerInstance& ci, clang::ASTContext const& ctx,
-                 llvm::raw_ostream& os)
+                 OutputSink& out)
     : CI(ci)
     , CTX(ctx)
-    , OS(os)
+    , Out(out)
+  {
+  }
+
+  /** Print an attribute with a text value.  */
+  void PrintAttribute(llvm::StringRef name, llvm::StringRef value)
+  {
+    this->Out.BeginAttribute(name);
+    this->Out.Text(value);
+    this->Out.EndAttribute();
+  }
+
+  /** Print an attribute with a numeric value.  */
+  template <typename T>
+  void PrintNumberAttribute(llvm::StringRef name, T const& value)
+  {
+    llvm::SmallString<32> s;
+    llvm::raw_svector_ostream os(s);
+    os << value;
+    this->PrintAttribute(name, os.str());
+  }
+
+  /** Print the XML IDREF value referencing another element.  */
+  template <typename T>
+  void PrintIdRef(char prefix, T const& id)
   {
+    llvm::SmallString<16> s;
+    llvm::raw_svector_ostream os(s);
+    os << prefix << id;
+    this->Out.Ref(os.str());
+  }
+
+  /** Print the XML ID value of the element being written.  */
+  template <typename T>
+  void PrintIdValue(char prefix, T const& id)
+  {
+    llvm::SmallString<16> s;
+    llvm::raw_svector_ostream os(s);
+    os << prefix << id;
+    this->Out.Id(os.str());
+  }
+
+  /** Print an attribute referencing one other element.  */
+  template <typename T>
+  void PrintIdRefAttribute(llvm::StringRef name, char prefix, T const& id)
+  {
+    this->Out.BeginAttribute(name);
+    this->PrintIdRef(prefix, id);
+    this->Out.EndAttribute();
   }
 
   // Represent cv qualifier state of one dump node.
@@ -195,14 +876,14 @@ protected:
     void bool_true() const {}
 
   public:
-    unsigned int Id;
+    uint64_t Id;
     DumpQual Qual;
     DumpId()
       : Id(0)
       , Qual()
     {
     }
-    DumpId(unsigned int id, DumpQual dq)
+    DumpId(uint64_t id, DumpQual dq)
       : Id(id)
       , Qual(dq)
     {
@@ -221,6 +902,10 @@ protected:
         return l.Qual < r.Qual;
       }
     }
+    friend bool operator==(DumpId const& l, DumpId const& r)
+    {
+      return l.Id == r.Id && !(l.Qual < r.Qual) && !(r.Qual < l.Qual);
+    }
     friend llvm::raw_ostream& operator<<(llvm::raw_ostream& os,
                                          DumpId const& id)
     {
@@ -233,13 +918,21 @@ protected:
   {
     DumpNode()
       : Index()
+      , Order(0)
+      , Shard(0)
       , Complete(false)
     {
     }
 
-    // Index in nodes ordered by first encounter.
+    // Index in nodes ordered by first encounter, or a stable id.
     DumpId Index;
 
+    // Position in nodes ordered by first encounter.
+    unsigned int Order;
+
+    // Shard to which the node is written, if sharding.
+    unsigned int Shard;
+
     // Whether the node is to be traversed completely.
     bool Complete;
   };
@@ -255,10 +948,12 @@ protected:
 
   void OutputUnimplementedDecl(clang::Decl const* d, DumpNode const* dn)
   {
-    /* clang-format off */
-    this->OS << "  <Unimplemented id=\"_" << dn->Index
-             << "\" kind=\"" << encodeXML(d->getDeclKindName()) << "\"/>\n";
-    /* clang-format on */
+    this->Out.BeginElement("Unimplemented");
+    this->Out.BeginAttribute("id");
+    this->PrintIdValue('_', dn->Index);
+    this->Out.EndAttribute();
+    this->PrintAttribute("kind", d->getDeclKindName());
+    this->Out.EndElement();
   }
 
 // Report all type nodes as unimplemented until overridden.
@@ -276,11 +971,12 @@ protected:
 
   void OutputUnimplementedType(clang::Type const* t, DumpNode const* dn)
   {
-    /* clang-format off */
-    this->OS << "  <Unimplemented id=\"_" << dn->Index
-             << "\" type_class=\"" << encodeXML(t->getTypeClassName())
-             << "\"/>\n";
-    /* clang-format on */
+    this->Out.BeginElement("Unimplemented");
+    this->Out.BeginAttribute("id");
+    this->PrintIdValue('_', dn->Index);
+    this->Out.EndAttribute();
+    this->PrintAttribute("type_class", t->getTypeClassName());
+    this->Out.EndElement();
   }
 
   std::string getNameOfFileEntryRef(cx::FileEntryRef f) const
@@ -289,6 +985,14 @@ protected:
     return std::string(f.getName());
 #else
     return std::string(f->getName());
+#endif
+  }
+  clang::FileEntry const* getFileEntryOfRef(cx::FileEntryRef f) const
+  {
+#if LLVM_VERSION_MAJOR >= 12
+    return &f.getFileEntry();
+#else
+    return f;
 #endif
   }
   cx::OptionalFileEntryRef getFileEntryRefForID(clang::FileID id) const
@@ -384,17 +1088,54 @@ class ASTVisitor : public ASTVisitorBase
 
     friend bool operator<(QueueEntry const& l, QueueEntry const& r)
     {
-      return l.DN->Index < r.DN->Index;
+      if (l.DN->Order != r.DN->Order) {
+        return l.DN->Order < r.DN->Order;
+      }
+      return l.DN->Index.Qual < r.DN->Index.Qual;
     }
   };
 
   struct CommentEntry
   {
-    unsigned int Index;
+    uint64_t Index;
     clang::RawComment const* Comment;
     DumpNode const* Attached;
   };
 
+  // Line and column of an offset in a source file.
+  struct LineColumn
+  {
+    unsigned int Line;
+    unsigned int Column;
+  };
+
+  // Information about a source file, computed on first use.
+  struct FileInfo
+  {
+    // Our index of the file, or 0 if it has no file entry.
+    uint64_t DumpFile = 0;
+    bool HaveDumpFile = false;
+
+    // Offsets at which the lines of the file begin, in order.
+    std::vector<unsigned int> LineOffsets;
+
+#if LLVM_VERSION_MAJOR >= 10
+    // Comments the parser kept from the file, by offset, if any.
+    std::map<unsigned int, clang::RawComment*> const* Comments = nullptr;
+#endif
+  };
+
+  // Members of a declaration context, possibly with duplicates until
+  // printed in id order.
+  typedef llvm::SmallVector<DumpId, 32> MemberList;
+
+  // Attributes of a declaration.  Names that are not literals are
+  // saved in the visitor's arena.
+  typedef llvm::SmallVector<llvm::StringRef, 4> AttributeList;
+
+  // Stable ids in use.
+  typedef ArenaSet<uint64_t> StableIdSet;
+
   class PrinterHelper : public clang::PrinterHelper
   {
     ASTVisitor& Visitor;
@@ -431,6 +1172,7 @@ class ASTVisitor : public ASTVisitorBase
 
   /** Allocate a dump node for a Clang type.  */
   DumpId AddTypeDumpNode(DumpType dt, bool complete, DumpQual dq = DumpQual());
+  DumpId AddTypeDumpNodeImpl(DumpType dt, bool complete, DumpQual dq);
 
   /** Allocate a dump node for a qualified DumpId.  */
   DumpId AddQualDumpNode(DumpId id);
@@ -439,6 +1181,20 @@ class ASTVisitor : public ASTVisitorBase
   template <typename K>
   DumpId AddDumpNodeImpl(K k, bool complete);
 
+  /** Get the text from which a stable id is computed.  */
+  std::string GetStableKey(clang::Decl const* d);
+  std::string GetStableKey(DumpType dt);
+  void AppendTypeDeclKeys(clang::QualType t, std::string& key);
+
+  /** Get the shard owning a declaration, or the shard in which a
+      type is first referenced.  */
+  unsigned int GetShard(clang::Decl const* d);
+  unsigned int GetShard(DumpType) { return this->CurrentShard; }
+
+  /** Allocate an unused nonzero id from the hash of a key.  */
+  static uint64_t AllocateStableId(std::string const& key,
+                                   StableIdSet& used);
+
 #if LLVM_VERSION_MAJOR >= 22
   /** Remove type info that we do not care about to avoid duplication.  */
   clang::QualType ConsolidateType(clang::QualType t);
@@ -446,9 +1202,18 @@ class ASTVisitor : public ASTVisitorBase
 #endif
 
   /** Allocate a dump node for a source file entry.  */
-  unsigned int AddDumpFile(cx::FileEntryRef f);
+  uint64_t AddDumpFile(cx::FileEntryRef f);
+
+  /** Get the information cached about a source file.  */
+  FileInfo& GetFileInfo(clang::FileID id);
+
+  /** Get the line and column of an offset in a source file.  */
+  LineColumn GetLineColumn(clang::FileID id, unsigned int offset);
+
+  /** Get our index of a source file, or 0 if it has no file entry.  */
+  uint64_t GetDumpFileForID(clang::FileID id);
 #if LLVM_VERSION_MAJOR < 12
-  unsigned int AddDumpFile(clang::FileEntry const& f)
+  uint64_t AddDumpFile(clang::FileEntry const& f)
   {
     return this->AddDumpFile(&f);
   }
@@ -456,19 +1221,44 @@ class ASTVisitor : public ASTVisitorBase
 
   /** Add class template specializations and instantiations for output.  */
   void AddClassTemplateDecl(clang::ClassTemplateDecl const* d,
-                            std::set<DumpId>* emitted = 0);
+                            MemberList* emitted = 0);
 
   /** Add function template specializations and instantiations for output.  */
   void AddFunctionTemplateDecl(clang::FunctionTemplateDecl const* d,
-                               std::set<DumpId>* emitted = 0);
+                               MemberList* emitted = 0);
+
+  /** Whether a specialization of a member template is left to be
+      reached by a reference instead of added with its context.  */
+  bool IsSpecializationLeftToReference(clang::TemplateSpecializationKind k);
 
   /** Add declaration context members for output.  */
   void AddDeclContextMembers(clang::DeclContext const* dc,
-                             std::set<DumpId>& emitted);
+                             MemberList& emitted);
 
   /** Add a starting declaration for output.  */
   void AddStartDecl(clang::Decl const* d);
 
+  /** Record a starting declaration as owning a shard.  */
+  void AddShardStartDecl(clang::Decl const* d);
+
+  // Exclusion pattern state of a declaration context.
+  struct ExcludeState
+  {
+    NamePatternSet::State State;
+    bool Excluded = false;
+  };
+
+  /** Get the exclusion pattern state of a declaration context.  */
+  ExcludeState const& GetExcludeState(clang::DeclContext const* dc);
+
+  /** Match the name of a declaration against exclusion patterns.  */
+  NamePatternSet::State StepExcludeState(NamePatternSet::State const& s,
+                                         clang::NamedDecl const* nd) const;
+
+  /** Return whether a declaration matches an exclusion pattern
+      or is nested inside a declaration context that does.  */
+  bool IsExcluded(clang::Decl const* d);
+
   /** Queue leftover nodes that do not need complete output.  */
   void QueueIncompleteDumpNodes();
 
@@ -477,6 +1267,13 @@ class ASTVisitor : public ASTVisitorBase
   void ProcessCommentQueue();
   void ProcessFileQueue();
 
+  /** Print the unity headers from which a file was reached.  */
+  void OutputUnityHeaders(cx::FileEntryRef f);
+
+  /** Record in the index the qualified name of a namespace-scope
+      declaration.  */
+  void IndexName(clang::Decl const* d, DumpNode const* dn);
+
   /** Output start tags on top of xml file. */
   void OutputStartXMLTags();
 
@@ -550,7 +1347,7 @@ class ASTVisitor : public ASTVisitorBase
       members of the given declaration context.  Also queues the
       context members for later output.  */
   void PrintMembersAttribute(clang::DeclContext const* dc);
-  void PrintMembersAttribute(std::set<DumpId> const& emitted);
+  void PrintMembersAttribute(MemberList& emitted);
 
   /** Print a bases="..." attribute listing the XML IDREFs for
       bases of the given class type.  Also queues the base classes
@@ -558,7 +1355,7 @@ class ASTVisitor : public ASTVisitorBase
   void PrintBasesAttribute(clang::CXXRecordDecl const* dx);
 
   /** Print an attributes="..." attribute listing the given attributes.  */
-  void PrintAttributesAttribute(std::vector<std::string> const& attrs);
+  void PrintAttributesAttribute(AttributeList const& attrs);
 
   /** Print an attributes="..." attribute listing the given
       declaration's attributes.  */
@@ -566,11 +1363,11 @@ class ASTVisitor : public ASTVisitorBase
 
   /** Get the attributes of the given function type.  */
   void GetFunctionTypeAttributes(clang::FunctionProtoType const* t,
-                                 std::vector<std::string>& attrs);
+                                 AttributeList& attrs);
 
   /** Get the attributes of the given declaration.  */
   void GetDeclAttributes(clang::Decl const* d,
-                         std::vector<std::string>& attrs);
+                         AttributeList& attrs);
 
   /** Print a throw="..." attribute listing the XML IDREFs for
       the types that the given function prototype declares in
@@ -586,6 +1383,10 @@ class ASTVisitor : public ASTVisitorBase
   /** Print a comment="..." attribute showing the declaration's comment.  */
   void PrintCommentAttribute(clang::Decl const* d, DumpNode const* dn);
 
+  /** Return whether the parser kept any comment near enough to the
+      declaration for Clang to attach it.  */
+  bool MayHaveComment(clang::Decl const* d);
+
   /** Flags used by function output methods to pass information
       to the OutputFunctionHelper method.  */
   enum FunctionHelperFlags
@@ -794,13 +1595,37 @@ class ASTVisitor : public ASTVisitorBase
   template <typename T>
   void OutputElaboratedTypeImpl(T const* t, DumpNode const* dn);
 
-  /** Queue declarations matching given qualified name in given context.  */
-  void LookupStart(clang::DeclContext const* dc, std::string const& name);
+  /** Find declarations matching given qualified name in given context.  */
+  void LookupStart(clang::DeclContext const* dc, std::string const& name,
+                   std::vector<clang::Decl const*>& starts);
+
+  /** Get declarations named by one start name component in given
+      context, including those visible through using directives.  */
+  std::vector<clang::NamedDecl const*> const& LookupStartComponent(
+    clang::DeclContext const* dc, std::string const& component);
+
+  /** Collect names of declarations in given context matching a glob.  */
+  void MatchStartNames(clang::DeclContext const* dc, llvm::StringRef glob,
+                       std::vector<std::string>& names,
+                       std::set<std::string>& seen);
+
+  /** Get namespaces nominated by using directives in given context,
+      directly or transitively, in lookup order.  */
+  std::vector<clang::DeclContext const*> const& GetUsingClosure(
+    clang::DeclContext const* dc);
+  void CollectUsingClosure(clang::DeclContext const* dc,
+                           std::vector<clang::DeclContext const*>& closure,
+                           std::set<clang::DeclContext const*>& seen);
 
 private:
   // List of starting declaration names.
   Options const& Opts;
 
+  // Arena holding the bookkeeping of this output pass, and the strings
+  // saved in it.  Declared before the containers that allocate from it.
+  llvm::BumpPtrAllocator Arena;
+  llvm::StringSaver Strings;
+
   // Total number of nodes to be dumped.
   unsigned int NodeCount;
 
@@ -813,6 +1638,10 @@ private:
   // Whether we need a File element for compiler builtins.
   bool FileBuiltin;
 
+  // Stable ids allocated so far for nodes and source files.
+  StableIdSet StableIds;
+  StableIdSet StableFileIds;
+
   // Whether we are in the complete or incomplete output step.
   bool RequireComplete;
 
@@ -822,50 +1651,132 @@ private:
   // Control declaration and type printing.
   clang::PrintingPolicy PrintingPolicy;
 
+  // Compiled declaration name exclusion patterns.
+  NamePatternSet Excludes;
+
+  // Map from declaration context to its exclusion pattern state.
+  typedef ArenaMap<clang::DeclContext const*, ExcludeState> ExcludeStateMap;
+  ExcludeStateMap ExcludeStates;
+
+  // Memoized start name component lookups by (primary) context.
+  typedef std::map<std::pair<clang::DeclContext const*, std::string>,
+                   std::vector<clang::NamedDecl const*>>
+    StartLookupMap;
+  StartLookupMap StartLookups;
+
+  // Memoized transitive using directive targets by (primary) context.
+  typedef std::map<clang::DeclContext const*,
+                   std::vector<clang::DeclContext const*>>
+    UsingClosureMap;
+  UsingClosureMap UsingClosures;
+
   // Map from clang AST declaration node to our dump status node.
-  typedef std::map<clang::Decl const*, DumpNode> DeclNodesMap;
+  typedef ArenaMap<clang::Decl const*, DumpNode> DeclNodesMap;
   DeclNodesMap DeclNodes;
 
+  // Memoized resolution of one type node to the id of its dump node
+  // for each combination of local qualifiers, class, and completeness
+  // requested.  Resolving again would find the same node and, since
+  // nodes only ever become complete, have no further effect.
+  struct TypeMemoId
+  {
+    unsigned int Quals;
+    clang::Type const* Class;
+    bool Complete;
+    DumpId Id;
+  };
+  struct TypeMemo
+  {
 #if LLVM_VERSION_MAJOR >= 22
-  // Memoize ConsolidateType results.
-  typedef std::map<clang::Type const*, clang::Type const*> ConsolidatedTypeMap;
-  ConsolidatedTypeMap ConsolidatedType;
+    // Memoized ConsolidateType result.
+    clang::Type const* Consolidated = nullptr;
 #endif
+    llvm::SmallVector<TypeMemoId, 2> Ids;
+  };
+  typedef ArenaMap<clang::Type const*, TypeMemo> TypeMemoMap;
+  TypeMemoMap TypeMemos;
 
   // Map from clang AST type node to our dump status node.
-  typedef std::map<DumpType, DumpNode> TypeNodesMap;
+  typedef ArenaMap<DumpType, DumpNode> TypeNodesMap;
   TypeNodesMap TypeNodes;
 
   // Map from qualified DumpId to our dump status node.
-  typedef std::map<DumpId, DumpNode> QualNodesMap;
+  typedef ArenaMap<DumpId, DumpNode> QualNodesMap;
   QualNodesMap QualNodes;
 
   // Map from clang file entry to our source file index.
-  typedef std::map<cx::FileEntryRef, unsigned int> FileNodesMap;
+  typedef std::map<cx::FileEntryRef, uint64_t> FileNodesMap;
   FileNodesMap FileNodes;
 
+  // Map from clang file id to information cached about the file.
+  typedef ArenaMap<clang::FileID, FileInfo> FileInfoMap;
+  FileInfoMap FileInfos;
+
   // Node traversal queue.
-  std::set<QueueEntry> Queue;
+  ArenaSet<QueueEntry> Queue;
 
   // Comment traversal queue.
   std::queue<CommentEntry> CommentQueue;
 
+  // Stream to which the names of namespace-scope declarations are
+  // written, if any.  The output sink writes element offsets to it.
+  llvm::raw_ostream* Index;
+
+  // Shard files to which elements are written, if any.
+  ShardWriter* Shards;
+
+  // Inclusions recorded while parsing a unity source, if any, and the
+  // file ids of its headers.
+  UnityIncludes const* Unity;
+  std::vector<uint64_t> UnityFileIds;
+
+  // Classes whose implicit members were not added, if any.
+  ImplicitMemberSkips const* Skips;
+
+  // Shard of the element being written.
+  unsigned int CurrentShard = 0;
+
+  // Start declarations owning each canonical declaration when sharding
+  // by start name.
+  typedef ArenaMap<clang::Decl const*, clang::NamedDecl const*> StartDeclMap;
+  StartDeclMap StartDecls;
+
   // File traversal queue.
   std::queue<cx::FileEntryRef> FileQueue;
 
 public:
   ASTVisitor(clang::CompilerInstance& ci, clang::ASTContext& ctx,
-             llvm::raw_ostream& os, Options const& opts)
-    : ASTVisitorBase(ci, ctx, os)
+             OutputSink& out, Options const& opts, llvm::raw_ostream* index,
+             ShardWriter* shards, UnityIncludes const* unity,
+             ImplicitMemberSkips const* skips)
+    : ASTVisitorBase(ci, ctx, out)
     , Opts(opts)
+    , Strings(Arena)
     , NodeCount(0)
     , FileCount(0)
     , FileBuiltin(false)
+    , StableIds(StableIdSet::allocator_type(Arena))
+    , StableFileIds(StableIdSet::allocator_type(Arena))
     , RequireComplete(true)
     , MangleContext(ctx.createMangleContext())
     , PrintingPolicy(ctx.getPrintingPolicy())
+    , ExcludeStates(ExcludeStateMap::allocator_type(Arena))
+    , DeclNodes(DeclNodesMap::allocator_type(Arena))
+    , TypeMemos(TypeMemoMap::allocator_type(Arena))
+    , TypeNodes(TypeNodesMap::allocator_type(Arena))
+    , QualNodes(QualNodesMap::allocator_type(Arena))
+    , FileInfos(FileInfoMap::allocator_type(Arena))
+    , Queue(ArenaSet<QueueEntry>::allocator_type(Arena))
+    , Index(index)
+    , Shards(shards)
+    , Unity(unity)
+    , Skips(skips)
+    , StartDecls(StartDeclMap::allocator_type(Arena))
   {
     this->PrintingPolicy.SuppressUnwrittenScope = true;
+    for (std::string const& name : opts.ExcludeNames) {
+      this->Excludes.add(name);
+    }
   }
 
   /** Visit declarations in the given translation unit.
@@ -947,6 +1858,11 @@ ASTVisitor::DumpId ASTVisitor::AddDeclDumpNode(clang::Decl const* d,
     }
   }
 
+  // Excluded declarations may be referenced but are never traversed.
+  if (complete && this->IsExcluded(d)) {
+    complete = false;
+  }
+
   return this->AddDumpNodeImpl(d, complete);
 }
 
@@ -966,8 +1882,32 @@ ASTVisitor::DumpId ASTVisitor::AddDeclDumpNodeForType(clang::Decl const* d,
   return id;
 }
 
-ASTVisitor::DumpId ASTVisitor::AddTypeDumpNode(DumpType dt, bool complete,
-                                               DumpQual dq)
+ASTVisitor::DumpId ASTVisitor::AddTypeDumpNode(DumpType dt, bool complete,
+                                               DumpQual dq)
+{
+  // Qualifiers collected by the caller are not part of the memo key.
+  if (dq) {
+    return this->AddTypeDumpNodeImpl(dt, complete, dq);
+  }
+
+  // The node of a type does not depend on qualifiers other than the
+  // local fast qualifiers, so the type pointer and those identify it.
+  unsigned int const quals = dt.Type.getLocalFastQualifiers();
+  TypeMemo& memo = this->TypeMemos[dt.Type.getTypePtr()];
+  for (TypeMemoId const& m : memo.Ids) {
+    if (m.Quals == quals && m.Class == dt.Class && m.Complete == complete) {
+      return m.Id;
+    }
+  }
+
+  // The memo entry stays in place while the type is resolved.
+  DumpId id = this->AddTypeDumpNodeImpl(dt, complete, dq);
+  memo.Ids.push_back(TypeMemoId{ quals, dt.Class, complete, id });
+  return id;
+}
+
+ASTVisitor::DumpId ASTVisitor::AddTypeDumpNodeImpl(DumpType dt, bool complete,
+                                                   DumpQual dq)
 {
 #if LLVM_VERSION_MAJOR >= 22
   dt.Type = this->ConsolidateType(dt.Type);
@@ -1125,7 +2065,7 @@ ASTVisitor::DumpId ASTVisitor::AddTypeDumpNode(DumpType dt, bool complete,
 clang::QualType ASTVisitor::ConsolidateType(clang::QualType t)
 {
   clang::Type const* oldTy = t.getTypePtr();
-  clang::Type const*& newTy = this->ConsolidatedType[oldTy];
+  clang::Type const*& newTy = this->TypeMemos[oldTy].Consolidated;
   if (!newTy) {
     newTy = this->ConsolidateTypeImpl(oldTy);
     assert(newTy != nullptr);
@@ -1189,6 +2129,11 @@ ASTVisitor::DumpId ASTVisitor::AddQualDumpNode(DumpId id)
   DumpNode* dn = this->GetDumpNode(id);
   if (!dn->Index) {
     dn->Index = id;
+    // Order after the unqualified node, or by first encounter when
+    // ids do not follow the encounter order.
+    dn->Order = this->Opts.StableIds ? ++this->NodeCount
+                                     : static_cast<unsigned int>(id.Id);
+    dn->Shard = this->CurrentShard;
     // Always treat CvQualifiedType nodes as complete.
     dn->Complete = true;
     this->Queue.insert(QueueEntry(dn));
@@ -1210,7 +2155,15 @@ ASTVisitor::DumpId ASTVisitor::AddDumpNodeImpl(K k, bool complete)
     }
   } else {
     // This is a new node.  Assign it an index.
-    dn->Index.Id = ++this->NodeCount;
+    dn->Order = ++this->NodeCount;
+    if (this->Opts.StableIds) {
+      dn->Index.Id = AllocateStableId(this->GetStableKey(k), this->StableIds);
+    } else {
+      dn->Index.Id = dn->Order;
+    }
+    if (this->Shards) {
+      dn->Shard = this->GetShard(k);
+    }
     dn->Complete = complete;
     if (complete || !this->RequireComplete) {
       // Node is complete.  Queue it.
@@ -1221,48 +2174,300 @@ ASTVisitor::DumpId ASTVisitor::AddDumpNodeImpl(K k, bool complete)
   return dn->Index;
 }
 
-unsigned int ASTVisitor::AddDumpFile(cx::FileEntryRef f)
+uint64_t ASTVisitor::AddDumpFile(cx::FileEntryRef f)
 {
-  unsigned int& index = this->FileNodes[f];
+  uint64_t& index = this->FileNodes[f];
   if (index == 0) {
-    index = ++this->FileCount;
+    if (this->Opts.StableIds) {
+      index = AllocateStableId(this->getNameOfFileEntryRef(f),
+                               this->StableFileIds);
+    } else {
+      index = ++this->FileCount;
+    }
     this->FileQueue.push(f);
   }
   return index;
 }
 
+static void computeLineOffsets(llvm::StringRef buf,
+                               std::vector<unsigned int>& offsets)
+{
+  // Count line endings the way the SourceManager does: "\r\n" ends
+  // one line.  Before Clang 14 so did "\n\r".
+  offsets.push_back(0);
+  for (size_t i = 0; i < buf.size(); ++i) {
+    char const c = buf[i];
+    if (c == '\n' || c == '\r') {
+#if LLVM_VERSION_MAJOR >= 14
+      if (c == '\r' && i + 1 < buf.size() && buf[i + 1] == '\n') {
+        ++i;
+      }
+#else
+      if (i + 1 < buf.size() && (buf[i + 1] == '\n' || buf[i + 1] == '\r') &&
+          buf[i + 1] != c) {
+        ++i;
+      }
+#endif
+      offsets.push_back(static_cast<unsigned int>(i + 1));
+    }
+  }
+}
+
+ASTVisitor::FileInfo& ASTVisitor::GetFileInfo(clang::FileID id)
+{
+  std::pair<FileInfoMap::iterator, bool> ins =
+    this->FileInfos.insert(FileInfoMap::value_type(id, FileInfo()));
+  FileInfo& fi = ins.first->second;
+  if (ins.second) {
+#if LLVM_VERSION_MAJOR >= 10
+    fi.Comments =
+      this->CI.getASTContext().getRawCommentList().getCommentsInFile(id);
+#endif
+  }
+  return fi;
+}
+
+ASTVisitor::LineColumn ASTVisitor::GetLineColumn(clang::FileID id,
+                                                 unsigned int offset)
+{
+  FileInfo& fi = this->GetFileInfo(id);
+  if (fi.LineOffsets.empty()) {
+    bool invalid = false;
+    llvm::StringRef buf =
+      this->CI.getSourceManager().getBufferData(id, &invalid);
+    computeLineOffsets(invalid ? llvm::StringRef() : buf, fi.LineOffsets);
+  }
+  std::vector<unsigned int>::const_iterator i = std::upper_bound(
+    fi.LineOffsets.begin(), fi.LineOffsets.end(), offset);
+  LineColumn lc;
+  lc.Line = static_cast<unsigned int>(i - fi.LineOffsets.begin());
+  lc.Column = offset - *(i - 1) + 1;
+  return lc;
+}
+
+uint64_t ASTVisitor::GetDumpFileForID(clang::FileID id)
+{
+  FileInfo& fi = this->GetFileInfo(id);
+  if (!fi.HaveDumpFile) {
+    if (cx::OptionalFileEntryRef f = this->getFileEntryRefForID(id)) {
+      fi.DumpFile = this->AddDumpFile(*f);
+    }
+    fi.HaveDumpFile = true;
+  }
+  return fi.DumpFile;
+}
+
+std::string ASTVisitor::GetStableKey(clang::Decl const* d)
+{
+  std::string key;
+  llvm::raw_string_ostream rso(key);
+  rso << d->getDeclKindName() << ' ';
+  clang::NamedDecl const* nd = clang::dyn_cast<clang::NamedDecl>(d);
+  if (nd) {
+    nd->getNameForDiagnostic(rso, this->PrintingPolicy, true);
+  }
+
+  // Distinguish overloads and the types of variable template instances.
+  if (clang::ValueDecl const* vd = clang::dyn_cast<clang::ValueDecl>(d)) {
+    rso << ' ' << vd->getType().getAsString(this->PrintingPolicy);
+  }
+
+  // Distinguish unnamed declarations by where they appear.
+  if (!nd || nd->getDeclName().isEmpty()) {
+    clang::SourceLocation sl = d->getLocation();
+    if (sl.isValid()) {
+      clang::FullSourceLoc fsl = this->CTX.getFullLoc(sl).getExpansionLoc();
+      clang::PresumedLoc pl =
+        this->CI.getSourceManager().getPresumedLoc(fsl);
+      if (pl.isValid()) {
+        rso << " at " << pl.getFilename() << ':' << pl.getLine() << ':'
+            << pl.getColumn();
+      }
+    }
+  }
+  return rso.str();
+}
+
+std::string ASTVisitor::GetStableKey(DumpType dt)
+{
+  std::string key = dt.Type->getTypeClassName();
+  key += ' ';
+  key += dt.Type.getAsString(this->PrintingPolicy);
+  if (dt.Class) {
+    key += " in ";
+    key += clang::QualType(dt.Class, 0).getAsString(this->PrintingPolicy);
+  }
+
+  // The same spelling may name different declarations, e.g. local
+  // classes of different functions.  Add the keys of the declarations
+  // a type names so that its key is canonical.
+  this->AppendTypeDeclKeys(dt.Type, key);
+  if (dt.Class) {
+    this->AppendTypeDeclKeys(clang::QualType(dt.Class, 0), key);
+  }
+  return key;
+}
+
+void ASTVisitor::AppendTypeDeclKeys(clang::QualType t, std::string& key)
+{
+  llvm::SmallVector<clang::QualType, 4> work(1, t);
+  while (!work.empty()) {
+    clang::Type const* tp = work.pop_back_val().getTypePtrOrNull();
+    if (!tp) {
+      continue;
+    }
+    clang::Decl const* d = nullptr;
+    if (clang::TagType const* tt = clang::dyn_cast<clang::TagType>(tp)) {
+      d = tt->getDecl();
+    } else if (clang::TypedefType const* tdt =
+                 clang::dyn_cast<clang::TypedefType>(tp)) {
+      d = tdt->getDecl();
+    } else if (clang::FunctionType const* ft =
+                 clang::dyn_cast<clang::FunctionType>(tp)) {
+      work.push_back(ft->getReturnType());
+      if (clang::FunctionProtoType const* fpt =
+            clang::dyn_cast<clang::FunctionProtoType>(ft)) {
+        for (clang::QualType p : fpt->param_types()) {
+          work.push_back(p);
+        }
+      }
+    } else if (clang::MemberPointerType const* mpt =
+                 clang::dyn_cast<clang::MemberPointerType>(tp)) {
+      clang::Type const* c =
+#if LLVM_VERSION_MAJOR >= 21
+        cx::deref(mpt->getQualifier()).getAsType()
+#else
+        mpt->getClass()
+#endif
+        ;
+      work.push_back(mpt->getPointeeType());
+      work.push_back(clang::QualType(c, 0));
+    } else if (clang::ArrayType const* at =
+                 clang::dyn_cast<clang::ArrayType>(tp)) {
+      work.push_back(at->getElementType());
+    } else if (!tp->getPointeeType().isNull()) {
+      work.push_back(tp->getPointeeType());
+    } else if (tp->isSugared()) {
+      work.push_back(tp->getLocallyUnqualifiedSingleStepDesugaredType());
+    }
+    if (d) {
+      key += " {";
+      key += this->GetStableKey(d);
+      key += '}';
+    }
+  }
+}
+
+unsigned int ASTVisitor::GetShard(clang::Decl const* d)
+{
+  if (this->Opts.ShardBy == "start") {
+    // Use the innermost enclosing start declaration.  Specializations
+    // are enclosed by the templates they specialize.
+    for (clang::Decl const* cur = d; cur;) {
+      StartDeclMap::const_iterator i =
+        this->StartDecls.find(cur->getCanonicalDecl());
+      if (i != this->StartDecls.end()) {
+        return this->Shards->GetShard(
+          i->second->getQualifiedNameAsString());
+      }
+      if (clang::ClassTemplateSpecializationDecl const* ctsd =
+            clang::dyn_cast<clang::ClassTemplateSpecializationDecl>(cur)) {
+        cur = ctsd->getSpecializedTemplate();
+        continue;
+      }
+      if (clang::FunctionDecl const* fd =
+            clang::dyn_cast<clang::FunctionDecl>(cur)) {
+        if (clang::FunctionTemplateDecl const* ftd =
+              fd->getPrimaryTemplate()) {
+          cur = ftd;
+          continue;
+        }
+      }
+      clang::DeclContext const* dc = cur->getDeclContext();
+      cur = dc ? clang::Decl::castFromDeclContext(dc) : nullptr;
+    }
+    return 0;
+  }
+
+  // Use the outermost enclosing namespace.
+  clang::NamespaceDecl const* top = nullptr;
+  for (clang::Decl const* cur = d; cur;) {
+    if (clang::NamespaceDecl const* nd =
+          clang::dyn_cast<clang::NamespaceDecl>(cur)) {
+      top = nd;
+    }
+    clang::DeclContext const* dc = cur->getDeclContext();
+    cur = dc ? clang::Decl::castFromDeclContext(dc) : nullptr;
+  }
+  if (!top) {
+    return 0;
+  }
+  return this->Shards->GetShard(top->isAnonymousNamespace()
+                                  ? std::string("(anonymous namespace)")
+                                  : top->getNameAsString());
+}
+
+uint64_t ASTVisitor::AllocateStableId(std::string const& key,
+                                      StableIdSet& used)
+{
+  // With 64-bit hashes a collision is unlikely even among millions of
+  // elements.  Should one occur, probe linearly.  The result then
+  // depends on encounter order, but only for the colliding keys.
+  uint64_t id = hashString(key);
+  while (id == 0 || !used.insert(id).second) {
+    ++id;
+  }
+  return id;
+}
+
+bool ASTVisitor::IsSpecializationLeftToReference(
+  clang::TemplateSpecializationKind k)
+{
+  // Specializations written in the source are always members.
+  return this->Opts.ReferencedSpecializations &&
+    (k == clang::TSK_Undeclared || k == clang::TSK_ImplicitInstantiation);
+}
+
 void ASTVisitor::AddClassTemplateDecl(clang::ClassTemplateDecl const* d,
-                                      std::set<DumpId>* emitted)
+                                      MemberList* emitted)
 {
   // Queue all the instantiations of this class template.
   for (clang::ClassTemplateDecl::spec_iterator i = d->spec_begin(),
                                                e = d->spec_end();
        i != e; ++i) {
-    clang::CXXRecordDecl const* rd = *i;
+    clang::ClassTemplateSpecializationDecl const* rd = *i;
+    if (emitted &&
+        this->IsSpecializationLeftToReference(rd->getSpecializationKind())) {
+      continue;
+    }
     DumpId id = this->AddDeclDumpNode(rd, true);
     if (id && emitted) {
-      emitted->insert(id);
+      emitted->push_back(id);
     }
   }
 }
 
 void ASTVisitor::AddFunctionTemplateDecl(clang::FunctionTemplateDecl const* d,
-                                         std::set<DumpId>* emitted)
+                                         MemberList* emitted)
 {
   // Queue all the instantiations of this function template.
   for (clang::FunctionTemplateDecl::spec_iterator i = d->spec_begin(),
                                                   e = d->spec_end();
        i != e; ++i) {
     clang::FunctionDecl const* fd = *i;
+    if (emitted && this->IsSpecializationLeftToReference(
+                     fd->getTemplateSpecializationKind())) {
+      continue;
+    }
     DumpId id = this->AddDeclDumpNode(fd, true);
     if (id && emitted) {
-      emitted->insert(id);
+      emitted->push_back(id);
     }
   }
 }
 
 void ASTVisitor::AddDeclContextMembers(clang::DeclContext const* dc,
-                                       std::set<DumpId>& emitted)
+                                       MemberList& emitted)
 {
   bool const isTranslationUnit = clang::isa<clang::TranslationUnitDecl>(dc);
 
@@ -1287,6 +2492,11 @@ void ASTVisitor::AddDeclContextMembers(clang::DeclContext const* dc,
       }
     }
 
+    // Skip declarations matching an exclusion pattern.
+    if (this->IsExcluded(d)) {
+      continue;
+    }
+
     // Ignore certain members.
     switch (d->getKind()) {
       case clang::Decl::CXXRecord: {
@@ -1343,7 +2553,27 @@ void ASTVisitor::AddDeclContextMembers(clang::DeclContext const* dc,
 
     // Queue this decl and print its id.
     if (DumpId id = this->AddDeclDumpNode(d, true)) {
-      emitted.insert(id);
+      emitted.push_back(id);
+    }
+  }
+}
+
+void ASTVisitor::AddShardStartDecl(clang::Decl const* d)
+{
+  clang::NamedDecl const* nd = clang::dyn_cast<clang::NamedDecl>(d);
+  if (!nd) {
+    return;
+  }
+  this->StartDecls[d->getCanonicalDecl()] = nd;
+  if (clang::UsingDecl const* ud = clang::dyn_cast<clang::UsingDecl>(d)) {
+    // Output refers to the targets of a using declaration in place
+    // of its shadows, so the targets belong to its shard unless they
+    // are start declarations themselves.
+    for (clang::UsingDecl::shadow_iterator i = ud->shadow_begin(),
+                                           e = ud->shadow_end();
+         i != e; ++i) {
+      this->StartDecls.insert(
+        std::make_pair((*i)->getTargetDecl()->getCanonicalDecl(), nd));
     }
   }
 }
@@ -1378,6 +2608,79 @@ void ASTVisitor::AddStartDecl(clang::Decl const* d)
   }
 }
 
+ASTVisitor::ExcludeState const& ASTVisitor::GetExcludeState(
+  clang::DeclContext const* dc)
+{
+  dc = dc->getPrimaryContext();
+  ExcludeStateMap::iterator i = this->ExcludeStates.find(dc);
+  if (i != this->ExcludeStates.end()) {
+    return i->second;
+  }
+
+  ExcludeState es;
+  if (dc->isTranslationUnit()) {
+    es.State = this->Excludes.start();
+  } else {
+    ExcludeState const& parent = this->GetExcludeState(dc->getParent());
+    es.Excluded = parent.Excluded;
+    if (!es.Excluded) {
+      if (clang::NamedDecl const* nd = clang::dyn_cast<clang::NamedDecl>(
+            clang::Decl::castFromDeclContext(dc))) {
+        es.State = this->StepExcludeState(parent.State, nd);
+        es.Excluded = this->Excludes.accepts(es.State);
+        if (dc->isInlineNamespace()) {
+          // Members may be named with or without the inline namespace.
+          NamePatternSet::State both;
+          std::set_union(es.State.begin(), es.State.end(),
+                         parent.State.begin(), parent.State.end(),
+                         std::back_inserter(both));
+          es.State.swap(both);
+        }
+      } else {
+        // Transparent contexts such as 'extern "C"' do not add a name.
+        es.State = parent.State;
+      }
+    }
+  }
+  return this->ExcludeStates[dc] = es;
+}
+
+NamePatternSet::State ASTVisitor::StepExcludeState(
+  NamePatternSet::State const& s, clang::NamedDecl const* nd) const
+{
+  clang::DeclarationName name = nd->getDeclName();
+  if (name.isIdentifier()) {
+    return this->Excludes.step(s, nd->getName());
+  }
+  return this->Excludes.step(s, name.getAsString());
+}
+
+bool ASTVisitor::IsExcluded(clang::Decl const* d)
+{
+  if (this->Excludes.empty()) {
+    return false;
+  }
+  clang::DeclContext const* dc = d->getDeclContext();
+  if (!dc) {
+    return false;
+  }
+  ExcludeState const& es = this->GetExcludeState(dc);
+  if (es.Excluded) {
+    return true;
+  }
+  if (es.State.empty()) {
+    return false;
+  }
+  if (clang::DeclContext const* ddc = clang::dyn_cast<clang::DeclContext>(d)) {
+    // Memoize the state for lookup of this context's own members.
+    return this->GetExcludeState(ddc).Excluded;
+  }
+  if (clang::NamedDecl const* nd = clang::dyn_cast<clang::NamedDecl>(d)) {
+    return this->Excludes.accepts(this->StepExcludeState(es.State, nd));
+  }
+  return false;
+}
+
 void ASTVisitor::QueueIncompleteDumpNodes()
 {
   // Queue declaration nodes that do not need complete output.
@@ -1405,6 +2708,10 @@ void ASTVisitor::ProcessQueue()
   while (!this->Queue.empty()) {
     QueueEntry qe = *this->Queue.begin();
     this->Queue.erase(this->Queue.begin());
+    if (this->Shards) {
+      this->CurrentShard = qe.DN->Shard;
+      this->Shards->Select(this->CurrentShard);
+    }
     switch (qe.Kind) {
       case QueueEntry::KindQual:
         this->OutputCvQualifiedType(qe.DN);
@@ -1416,6 +2723,21 @@ void ASTVisitor::ProcessQueue()
         this->OutputType(qe.Type, qe.DN);
         break;
     }
+    if (this->Index && qe.Kind == QueueEntry::KindDecl) {
+      this->IndexName(qe.Decl, qe.DN);
+    }
+  }
+}
+
+void ASTVisitor::IndexName(clang::Decl const* d, DumpNode const* dn)
+{
+  clang::NamedDecl const* nd = clang::dyn_cast<clang::NamedDecl>(d);
+  if (!nd || !nd->getDeclContext()->isFileContext()) {
+    return;
+  }
+  std::string name = nd->getQualifiedNameAsString();
+  if (!name.empty()) {
+    *this->Index << "name _" << dn->Index << ' ' << name << '\n';
   }
 }
 
@@ -1424,62 +2746,91 @@ void ASTVisitor::ProcessCommentQueue()
   while (!this->CommentQueue.empty()) {
     CommentEntry c = this->CommentQueue.front();
     this->CommentQueue.pop();
+    if (this->Shards) {
+      this->Shards->Select(c.Attached ? c.Attached->Shard : 0);
+    }
 
-    this->OS << "  <Comment id=\"c" << c.Index << "\"";
+    this->Out.BeginElement("Comment");
+    this->Out.BeginAttribute("id");
+    this->PrintIdValue('c', c.Index);
+    this->Out.EndAttribute();
     if (c.Attached) {
-      this->OS << " attached=\"_" << c.Attached->Index << "\"";
+      this->PrintIdRefAttribute("attached", '_', c.Attached->Index);
     }
     clang::SourceLocation bl = c.Comment->getSourceRange().getBegin();
     clang::SourceLocation el = c.Comment->getSourceRange().getEnd();
     if (bl.isValid() && el.isValid()) {
-      clang::FullSourceLoc bfl = this->CTX.getFullLoc(bl).getExpansionLoc();
-      clang::FullSourceLoc efl = this->CTX.getFullLoc(el).getExpansionLoc();
+      // Resolve positions through our line tables so that comments
+      // alternating between files do not defeat the single-entry
+      // line lookup cache of the SourceManager.
       clang::SourceManager const& sm = this->CI.getSourceManager();
-      clang::FileID bid = bfl.getFileID();
-      clang::FileID eid = efl.getFileID();
-      cx::OptionalFileEntryRef bf = this->getFileEntryRefForID(bid);
-      cx::OptionalFileEntryRef ef = this->getFileEntryRefForID(eid);
+      std::pair<clang::FileID, unsigned int> b =
+        sm.getDecomposedExpansionLoc(bl);
+      std::pair<clang::FileID, unsigned int> e =
+        sm.getDecomposedExpansionLoc(el);
+      cx::OptionalFileEntryRef bf = this->getFileEntryRefForID(b.first);
+      cx::OptionalFileEntryRef ef = this->getFileEntryRefForID(e.first);
       if (bf && bf == ef) {
-        unsigned int fi = this->AddDumpFile(*bf);
-        unsigned int boff = sm.getFileOffset(bfl);
-        unsigned int eoff = sm.getFileOffset(efl);
-        /* clang-format off */
-        this->OS <<
-         " file=\"f" << fi << "\""
-         " begin_line=\"" << sm.getLineNumber(bid, boff) << "\""
-         " begin_column=\"" << sm.getColumnNumber(bid, boff) << "\""
-         " begin_offset=\"" << boff << "\""
-         " end_line=\"" << sm.getLineNumber(eid, eoff) << "\""
-         " end_column=\"" << sm.getColumnNumber(eid, eoff) << "\""
-         " end_offset=\"" << eoff << "\""
-         ;
-        /* clang-format on */
+        uint64_t fi = this->AddDumpFile(*bf);
+        LineColumn blc = this->GetLineColumn(b.first, b.second);
+        LineColumn elc = this->GetLineColumn(e.first, e.second);
+        this->PrintIdRefAttribute("file", 'f', fi);
+        this->PrintNumberAttribute("begin_line", blc.Line);
+        this->PrintNumberAttribute("begin_column", blc.Column);
+        this->PrintNumberAttribute("begin_offset", b.second);
+        this->PrintNumberAttribute("end_line", elc.Line);
+        this->PrintNumberAttribute("end_column", elc.Column);
+        this->PrintNumberAttribute("end_offset", e.second);
       }
     }
-    this->OS << "/>\n";
+    this->Out.EndElement();
+  }
+}
+
+void ASTVisitor::OutputUnityHeaders(cx::FileEntryRef f)
+{
+  std::set<unsigned int> const* headers =
+    this->Unity->getHeadersReaching(this->getFileEntryOfRef(f));
+  if (!headers) {
+    return;
+  }
+  this->Out.BeginAttribute("headers");
+  char const* sep = "";
+  for (unsigned int h : *headers) {
+    if (h < this->UnityFileIds.size()) {
+      this->Out.Text(sep);
+      this->PrintIdRef('f', this->UnityFileIds[h]);
+      sep = " ";
+    }
   }
+  this->Out.EndAttribute();
 }
 
 void ASTVisitor::ProcessFileQueue()
 {
+  if (this->Shards) {
+    this->Shards->Select(0);
+  }
   if (this->FileBuiltin) {
-    /* clang-format off */
-    this->OS <<
-      "  <File id=\"f0\" name=\"" << encodeXML("<builtin>") << "\"/>\n"
-      ;
-    /* clang-format on */
+    this->Out.BeginElement("File");
+    this->Out.BeginAttribute("id");
+    this->PrintIdValue('f', 0);
+    this->Out.EndAttribute();
+    this->PrintAttribute("name", "<builtin>");
+    this->Out.EndElement();
   }
   while (!this->FileQueue.empty()) {
     cx::FileEntryRef f = this->FileQueue.front();
     this->FileQueue.pop();
-    /* clang-format off */
-    this->OS <<
-      "  <File"
-      " id=\"f" << this->FileNodes[f] << "\""
-      " name=\"" << encodeXML(this->getNameOfFileEntryRef(f)) << "\""
-      "/>\n"
-      ;
-    /* clang-format on */
+    this->Out.BeginElement("File");
+    this->Out.BeginAttribute("id");
+    this->PrintIdValue('f', this->FileNodes[f]);
+    this->Out.EndAttribute();
+    this->PrintAttribute("name", this->getNameOfFileEntryRef(f));
+    if (this->Unity) {
+      this->OutputUnityHeaders(f);
+    }
+    this->Out.EndElement();
   }
 }
 
@@ -1528,22 +2879,25 @@ void ASTVisitor::OutputCvQualifiedType(DumpNode const* dn)
 
   // Create a special CvQualifiedType element to hold top-level
   // cv-qualifiers for a real type node.
-  this->OS << "  <CvQualifiedType id=\"_" << id << "\"";
+  this->Out.BeginElement("CvQualifiedType");
+  this->Out.BeginAttribute("id");
+  this->PrintIdValue('_', id);
+  this->Out.EndAttribute();
 
   // Refer to the unqualified type.
-  this->OS << " type=\"_" << id.Id << "\"";
+  this->PrintIdRefAttribute("type", '_', id.Id);
 
   // Add the cv-qualification attributes.
   if (id.Qual.IsConst) {
-    this->OS << " const=\"1\"";
+    this->PrintAttribute("const", "1");
   }
   if (id.Qual.IsVolatile) {
-    this->OS << " volatile=\"1\"";
+    this->PrintAttribute("volatile", "1");
   }
   if (id.Qual.IsRestrict) {
-    this->OS << " restrict=\"1\"";
+    this->PrintAttribute("restrict", "1");
   }
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 ASTVisitor::DumpId ASTVisitor::GetContextIdRef(clang::DeclContext const* dc)
@@ -1574,16 +2928,22 @@ void ASTVisitor::PrintTypeIdRef(clang::QualType t, bool complete)
   DumpId id = this->AddTypeDumpNode(t, complete);
 
   // Print the reference.
-  this->OS << "_" << id;
+  this->PrintIdRef('_', id);
 }
 
 void ASTVisitor::PrintIdAttribute(DumpNode const* dn)
 {
-  this->OS << " id=\"_" << dn->Index << "\"";
+  this->Out.BeginAttribute("id");
+  this->PrintIdValue('_', dn->Index);
+  this->Out.EndAttribute();
 }
 
 void ASTVisitor::PrintNameAttribute(std::string const& name)
 {
+  if (name.find("__castxml") == std::string::npos) {
+    this->PrintAttribute("name", name);
+    return;
+  }
   std::string n = name;
   n = stringReplace(n, "__castxml__float128_s", "__float128");
   n = stringReplace(n, "__castxml_Float32_s", "_Float32");
@@ -1591,7 +2951,7 @@ void ASTVisitor::PrintNameAttribute(std::string const& name)
   n = stringReplace(n, "__castxml_Float64_s", "_Float64");
   n = stringReplace(n, "__castxml_Float64x_s", "_Float64x");
   n = stringReplace(n, "__castxml_Float128_s", "_Float128");
-  this->OS << " name=\"" << encodeXML(n) << "\"";
+  this->PrintAttribute("name", n);
 }
 
 void ASTVisitor::PrintNameAttribute(llvm::StringRef name)
@@ -1619,12 +2979,12 @@ void ASTVisitor::PrintMangledAttribute(clang::NamedDecl const* d)
     s = s.substr(1);
   }
 
-  this->OS << " mangled=\"" << encodeXML(s) << "\"";
+  this->PrintAttribute("mangled", s);
 }
 
 void ASTVisitor::PrintOffsetAttribute(unsigned int const& offset)
 {
-  this->OS << " offset=\"" << offset << "\"";
+  this->PrintNumberAttribute("offset", offset);
 }
 
 void ASTVisitor::PrintABIAttributes(clang::TypeDecl const* d)
@@ -1639,8 +2999,8 @@ void ASTVisitor::PrintABIAttributes(clang::TypeDecl const* d)
 
 void ASTVisitor::PrintABIAttributes(clang::TypeInfo const& t)
 {
-  this->OS << " size=\"" << t.Width << "\"";
-  this->OS << " align=\"" << t.Align << "\"";
+  this->PrintNumberAttribute("size", t.Width);
+  this->PrintNumberAttribute("align", t.Align);
 }
 
 void ASTVisitor::PrintInitAttribute(clang::Expr const* init)
@@ -1648,57 +3008,66 @@ void ASTVisitor::PrintInitAttribute(clang::Expr const* init)
   if (!init) {
     return;
   }
-  this->OS << " init=\"";
   std::string s;
   llvm::raw_string_ostream rso(s);
   PrinterHelper ph(*this);
   init->printPretty(rso, &ph, this->PrintingPolicy);
-  this->OS << encodeXML(rso.str());
-  this->OS << "\"";
+  this->PrintAttribute("init", rso.str());
 }
 
 void ASTVisitor::PrintBaseTypeAttribute(clang::Type const* c, bool complete)
 {
-  this->OS << " basetype=\"";
+  this->Out.BeginAttribute("basetype");
   this->PrintTypeIdRef(clang::QualType(c, 0), complete);
-  this->OS << "\"";
+  this->Out.EndAttribute();
 }
 
 void ASTVisitor::PrintTypeAttribute(clang::QualType t, bool complete)
 {
-  this->OS << " type=\"";
+  this->Out.BeginAttribute("type");
   this->PrintTypeIdRef(t, complete);
-  this->OS << "\"";
+  this->Out.EndAttribute();
 }
 
 void ASTVisitor::PrintReturnsAttribute(clang::QualType t, bool complete)
 {
-  this->OS << " returns=\"";
+  this->Out.BeginAttribute("returns");
   this->PrintTypeIdRef(t, complete);
-  this->OS << "\"";
+  this->Out.EndAttribute();
 }
 
 void ASTVisitor::PrintLocationAttribute(clang::Decl const* d)
 {
   clang::SourceLocation sl = d->getLocation();
   if (sl.isValid()) {
-    clang::FullSourceLoc fsl = this->CTX.getFullLoc(sl).getExpansionLoc();
-    if (cx::OptionalFileEntryRef f =
-          this->getFileEntryRefForID(fsl.getFileID())) {
-      unsigned int id = this->AddDumpFile(*f);
-      unsigned int line = fsl.getExpansionLineNumber();
-      /* clang-format off */
-      this->OS <<
-        " location=\"f" << id << ":" << line << "\""
-        " file=\"f" << id << "\""
-        " line=\"" << line << "\"";
-      /* clang-format on */
+    // Resolve the location through our per-file tables.  Consecutive
+    // declarations from different files would defeat the single-entry
+    // line lookup cache of the SourceManager.
+    std::pair<clang::FileID, unsigned int> loc =
+      this->CI.getSourceManager().getDecomposedExpansionLoc(sl);
+    if (uint64_t id = this->GetDumpFileForID(loc.first)) {
+      LineColumn lc = this->GetLineColumn(loc.first, loc.second);
+      this->Out.BeginAttribute("location");
+      this->PrintIdRef('f', id);
+      this->Out.Text(":" + std::to_string(lc.Line));
+      this->Out.EndAttribute();
+      this->PrintIdRefAttribute("file", 'f', id);
+      this->PrintNumberAttribute("line", lc.Line);
+      if (this->Opts.LocationColumns && this->Opts.CastXml) {
+        this->PrintNumberAttribute("column", lc.Column);
+        this->PrintNumberAttribute("file_offset", loc.second);
+      }
       return;
     }
   }
   if (d->isImplicit()) {
     this->FileBuiltin = true;
-    this->OS << " location=\"f0:0\" file=\"f0\" line=\"0\"";
+    this->Out.BeginAttribute("location");
+    this->PrintIdRef('f', 0);
+    this->Out.Text(":0");
+    this->Out.EndAttribute();
+    this->PrintIdRefAttribute("file", 'f', 0);
+    this->PrintAttribute("line", "0");
   }
 }
 
@@ -1765,13 +3134,13 @@ void ASTVisitor::PrintAccessAttribute(clang::AccessSpecifier as)
 {
   switch (as) {
     case clang::AS_private:
-      this->OS << " access=\"private\"";
+      this->PrintAttribute("access", "private");
       break;
     case clang::AS_protected:
-      this->OS << " access=\"protected\"";
+      this->PrintAttribute("access", "protected");
       break;
     case clang::AS_public:
-      this->OS << " access=\"public\"";
+      this->PrintAttribute("access", "public");
       break;
     case clang::AS_none:
       break;
@@ -1783,7 +3152,7 @@ void ASTVisitor::PrintContextAttribute(clang::Decl const* d,
 {
   clang::DeclContext const* dc = d->getDeclContext();
   if (DumpId id = this->GetContextIdRef(dc)) {
-    this->OS << " context=\"_" << id << "\"";
+    this->PrintIdRefAttribute("context", '_', id);
     if (dc->isRecord()) {
       clang::AccessSpecifier as = d->getAccess();
       this->PrintAccessAttribute(as != clang::AS_none ? as : alt);
@@ -1793,74 +3162,76 @@ void ASTVisitor::PrintContextAttribute(clang::Decl const* d,
 
 void ASTVisitor::PrintMembersAttribute(clang::DeclContext const* dc)
 {
-  std::set<DumpId> emitted;
+  MemberList emitted;
   this->AddDeclContextMembers(dc, emitted);
   this->PrintMembersAttribute(emitted);
 }
 
-void ASTVisitor::PrintMembersAttribute(std::set<DumpId> const& emitted)
+void ASTVisitor::PrintMembersAttribute(MemberList& emitted)
 {
   if (!emitted.empty()) {
-    this->OS << " members=\"";
+    std::sort(emitted.begin(), emitted.end());
+    emitted.erase(std::unique(emitted.begin(), emitted.end()), emitted.end());
+    this->Out.BeginAttribute("members");
     char const* sep = "";
-    for (std::set<DumpId>::const_iterator i = emitted.begin(),
-                                          e = emitted.end();
-         i != e; ++i) {
-      this->OS << sep << "_" << *i;
+    for (DumpId const& id : emitted) {
+      this->Out.Text(sep);
+      this->PrintIdRef('_', id);
       sep = " ";
     }
-    this->OS << "\"";
+    this->Out.EndAttribute();
   }
 }
 
 void ASTVisitor::PrintBasesAttribute(clang::CXXRecordDecl const* dx)
 {
-  this->OS << " bases=\"";
+  this->Out.BeginAttribute("bases");
   char const* sep = "";
   for (clang::CXXRecordDecl::base_class_const_iterator i = dx->bases_begin(),
                                                        e = dx->bases_end();
        i != e; ++i) {
-    this->OS << sep;
+    this->Out.Text(sep);
     sep = " ";
     switch (i->getAccessSpecifier()) {
       case clang::AS_private:
-        this->OS << "private:";
+        this->Out.Text("private:");
         break;
       case clang::AS_protected:
-        this->OS << "protected:";
+        this->Out.Text("protected:");
         break;
       default:
         break;
     }
     this->PrintTypeIdRef(i->getType().getCanonicalType(), true);
   }
-  this->OS << "\"";
+  this->Out.EndAttribute();
 }
 
 void ASTVisitor::PrintAttributesAttribute(
-  std::vector<std::string> const& attrs)
+  AttributeList const& attrs)
 {
   if (attrs.empty()) {
     return;
   }
-  this->OS << " attributes=\"";
+  this->Out.BeginAttribute("attributes");
   char const* sep = "";
-  for (std::string const& a : attrs) {
-    this->OS << sep << encodeXML(a);
+  for (llvm::StringRef a : attrs) {
+    this->Out.Text(sep);
+    this->Out.Text(a);
     sep = " ";
   }
-  this->OS << "\"";
+  this->Out.EndAttribute();
 }
 
 void ASTVisitor::PrintAttributesAttribute(clang::Decl const* d)
 {
-  std::vector<std::string> attributes;
+  AttributeList attributes;
   this->GetDeclAttributes(d, attributes);
   this->PrintAttributesAttribute(attributes);
 }
 
 void ASTVisitor::GetFunctionTypeAttributes(clang::FunctionProtoType const* t,
-                                           std::vector<std::string>& attrs)
+                                           AttributeList& attrs)
 {
   switch (t->getExtInfo().getCC()) {
     case clang::CallingConv::CC_C:
@@ -1880,22 +3251,26 @@ void ASTVisitor::GetFunctionTypeAttributes(clang::FunctionProtoType const* t,
 }
 
 void ASTVisitor::GetDeclAttributes(clang::Decl const* d,
-                                   std::vector<std::string>& attrs)
+                                   AttributeList& attrs)
 {
-  std::string annotationXML;
+  bool annotated = false;
   for (auto const* a : d->specific_attrs<clang::AnnotateAttr>()) {
-    attrs.push_back("annotate(" + a->getAnnotation().str() + ")");
-    if (!annotationXML.empty()) {
-      // Separate annotations by a newline.
-      annotationXML += "&#xA;"; // LF
-    }
-    annotationXML += encodeXML(a->getAnnotation().str());
-  }
-  if (d->hasAttr<clang::AnnotateAttr>()) {
+    attrs.push_back(this->Strings.save(llvm::Twine("annotate(") +
+                                       a->getAnnotation() + ")"));
     if (this->Opts.CastXml) {
-      this->OS << " annotation=\"" << annotationXML << "\"";
+      if (annotated) {
+        // Separate annotations by a newline.
+        this->Out.Text("\n");
+      } else {
+        this->Out.BeginAttribute("annotation");
+        annotated = true;
+      }
+      this->Out.Text(a->getAnnotation());
     }
   }
+  if (annotated) {
+    this->Out.EndAttribute();
+  }
 
   if (d->hasAttr<clang::DeprecatedAttr>()) {
     attrs.push_back("deprecated");
@@ -1903,7 +3278,7 @@ void ASTVisitor::GetDeclAttributes(clang::Decl const* d,
       clang::DeprecatedAttr* depAttr = d->getAttr<clang::DeprecatedAttr>();
       if (!depAttr->getMessage().empty()) {
         std::string depMsgText = std::string(depAttr->getMessage());
-        this->OS << " deprecation=\"" << encodeXML(depMsgText) << "\"";
+        this->PrintAttribute("deprecation", depMsgText);
       }
     }
   }
@@ -1931,21 +3306,21 @@ void ASTVisitor::PrintThrowsAttribute(clang::FunctionProtoType const* fpt,
   if (fpt && fpt->hasDynamicExceptionSpec()) {
     clang::FunctionProtoType::exception_iterator i = fpt->exception_begin();
     clang::FunctionProtoType::exception_iterator e = fpt->exception_end();
-    this->OS << " throw=\"";
+    this->Out.BeginAttribute("throw");
     char const* sep = "";
     for (; i != e; ++i) {
-      this->OS << sep;
+      this->Out.Text(sep);
       this->PrintTypeIdRef(*i, complete);
       sep = " ";
     }
-    this->OS << "\"";
+    this->Out.EndAttribute();
   }
 }
 
 void ASTVisitor::PrintBefriendingAttribute(clang::CXXRecordDecl const* dx)
 {
   if (dx && dx->hasFriends()) {
-    this->OS << " befriending=\"";
+    this->Out.BeginAttribute("befriending");
     char const* sep = "";
     for (clang::CXXRecordDecl::friend_iterator i = dx->friend_begin(),
                                                e = dx->friend_end();
@@ -1958,16 +3333,17 @@ void ASTVisitor::PrintBefriendingAttribute(clang::CXXRecordDecl const* dx)
         }
 
         if (DumpId id = this->AddDeclDumpNode(nd, false)) {
-          this->OS << sep << "_" << id;
+          this->Out.Text(sep);
+          this->PrintIdRef('_', id);
           sep = " ";
         }
       } else if (clang::TypeSourceInfo const* tsi = fd->getFriendType()) {
-        this->OS << sep;
+        this->Out.Text(sep);
         this->PrintTypeIdRef(tsi->getType(), false);
         sep = " ";
       }
     }
-    this->OS << "\"";
+    this->Out.EndAttribute();
   }
 }
 
@@ -1977,12 +3353,49 @@ void ASTVisitor::PrintCommentAttribute(clang::Decl const* d,
   if (!this->Opts.CastXml) {
     return;
   }
+  if (!this->MayHaveComment(d)) {
+    return;
+  }
   if (clang::RawComment const* rc = this->CTX.getRawCommentNoCache(d)) {
-    unsigned int index = ++this->CommentCount;
+    // A declaration has at most one comment, so with stable ids
+    // reuse the id of the declaration.
+    uint64_t index =
+      this->Opts.StableIds ? dn->Index.Id : ++this->CommentCount;
     CommentEntry e = { index, rc, dn };
     this->CommentQueue.push(e);
-    this->OS << " comment=\"c" << index << "\"";
+    this->PrintIdRefAttribute("comment", 'c', index);
+  }
+}
+
+bool ASTVisitor::MayHaveComment(clang::Decl const* d)
+{
+#if LLVM_VERSION_MAJOR >= 10
+  // Clang looks for a comment in the file of the declaration: the last
+  // one before it, or a trailing one starting on the same line.  Rule
+  // out declarations that have neither using the comment index of the
+  // file.  Leave declarations from macros and external sources to Clang.
+  clang::SourceLocation sl = d->getLocation();
+  if (sl.isInvalid() || !sl.isFileID() || this->CTX.getExternalSource()) {
+    return true;
   }
+  std::pair<clang::FileID, unsigned int> loc =
+    this->CI.getSourceManager().getDecomposedLoc(sl);
+  FileInfo const& fi = this->GetFileInfo(loc.first);
+  if (!fi.Comments || fi.Comments->empty()) {
+    return false;
+  }
+  std::map<unsigned int, clang::RawComment*>::const_iterator i =
+    fi.Comments->lower_bound(loc.second);
+  if (i != fi.Comments->begin()) {
+    return true;
+  }
+  return i != fi.Comments->end() &&
+    this->GetLineColumn(loc.first, i->first).Line ==
+    this->GetLineColumn(loc.first, loc.second).Line;
+#else
+  static_cast<void>(d);
+  return true;
+#endif
 }
 
 bool ASTVisitor::HaveFloat128Type() const
@@ -1997,24 +3410,38 @@ bool ASTVisitor::HaveFloat128Type() const
 void ASTVisitor::PrintCastXMLTypedef(clang::TypedefDecl const* d,
                                      DumpNode const* dn)
 {
-  this->OS << "  <FundamentalType";
+  this->Out.BeginElement("FundamentalType");
   this->PrintIdAttribute(dn);
   if (d->getName() == "__castxml__float80") {
-    this->OS << " name=\"__float80\" size=\"128\" align=\"128\"";
+    this->PrintAttribute("name", "__float80");
+    this->PrintAttribute("size", "128");
+    this->PrintAttribute("align", "128");
   } else if (d->getName() == "__castxml__float128") {
-    this->OS << " name=\"__float128\" size=\"128\" align=\"128\"";
+    this->PrintAttribute("name", "__float128");
+    this->PrintAttribute("size", "128");
+    this->PrintAttribute("align", "128");
   } else if (d->getName() == "__castxml_Float32") {
-    this->OS << " name=\"_Float32\" size=\"32\" align=\"32\"";
+    this->PrintAttribute("name", "_Float32");
+    this->PrintAttribute("size", "32");
+    this->PrintAttribute("align", "32");
   } else if (d->getName() == "__castxml_Float32x") {
-    this->OS << " name=\"_Float32x\" size=\"64\" align=\"64\"";
+    this->PrintAttribute("name", "_Float32x");
+    this->PrintAttribute("size", "64");
+    this->PrintAttribute("align", "64");
   } else if (d->getName() == "__castxml_Float64") {
-    this->OS << " name=\"_Float64\" size=\"64\" align=\"64\"";
+    this->PrintAttribute("name", "_Float64");
+    this->PrintAttribute("size", "64");
+    this->PrintAttribute("align", "64");
   } else if (d->getName() == "__castxml_Float64x") {
-    this->OS << " name=\"_Float64x\" size=\"128\" align=\"128\"";
+    this->PrintAttribute("name", "_Float64x");
+    this->PrintAttribute("size", "128");
+    this->PrintAttribute("align", "128");
   } else if (d->getName() == "__castxml_Float128") {
-    this->OS << " name=\"_Float128\" size=\"128\" align=\"128\"";
+    this->PrintAttribute("name", "_Float128");
+    this->PrintAttribute("size", "128");
+    this->PrintAttribute("align", "128");
   }
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 bool ASTVisitor::IsCastXMLTypedefType(clang::QualType t) const
@@ -2053,7 +3480,7 @@ void ASTVisitor::OutputFunctionHelper(clang::FunctionDecl const* d,
                                       unsigned int flags,
                                       cx::optional<std::string> const& name)
 {
-  this->OS << "  <" << tag;
+  this->Out.BeginElement(tag);
   this->PrintIdAttribute(dn);
   if (name) {
     this->PrintNameAttribute(*name);
@@ -2065,49 +3492,50 @@ void ASTVisitor::OutputFunctionHelper(clang::FunctionDecl const* d,
   this->PrintLocationAttribute(d);
 
   if (flags & FH_Static) {
-    this->OS << " static=\"1\"";
+    this->PrintAttribute("static", "1");
   }
   if (flags & FH_Explicit) {
-    this->OS << " explicit=\"1\"";
+    this->PrintAttribute("explicit", "1");
   }
   if (flags & FH_Const) {
-    this->OS << " const=\"1\"";
+    this->PrintAttribute("const", "1");
   }
   if (flags & FH_Virtual) {
-    this->OS << " virtual=\"1\"";
+    this->PrintAttribute("virtual", "1");
   }
   if (flags & FH_Pure) {
-    this->OS << " pure_virtual=\"1\"";
+    this->PrintAttribute("pure_virtual", "1");
   }
   if (d->isInlined()) {
-    this->OS << " inline=\"1\"";
+    this->PrintAttribute("inline", "1");
   }
   if (d->getStorageClass() == clang::SC_Extern) {
-    this->OS << " extern=\"1\"";
+    this->PrintAttribute("extern", "1");
   }
   if (d->isImplicit()) {
-    this->OS << " artificial=\"1\"";
+    this->PrintAttribute("artificial", "1");
   }
 
   if (clang::CXXMethodDecl const* md =
         clang::dyn_cast<clang::CXXMethodDecl>(d)) {
     if (md->size_overridden_methods() > 0) {
-      this->OS << " overrides=\"";
+      this->Out.BeginAttribute("overrides");
       char const* sep = "";
       for (clang::CXXMethodDecl::method_iterator
              i = md->begin_overridden_methods(),
              e = md->end_overridden_methods();
            i != e; ++i) {
         if (DumpId id = this->AddDeclDumpNode(*i, false)) {
-          this->OS << sep << "_" << id;
+          this->Out.Text(sep);
+          this->PrintIdRef('_', id);
           sep = " ";
         }
       }
-      this->OS << "\"";
+      this->Out.EndAttribute();
     }
   }
 
-  std::vector<std::string> attributes;
+  AttributeList attributes;
 
   if (clang::FunctionProtoType const* fpt =
         d->getType()->getAs<clang::FunctionProtoType>()) {
@@ -2125,7 +3553,6 @@ void ASTVisitor::OutputFunctionHelper(clang::FunctionDecl const* d,
   this->PrintCommentAttribute(d, dn);
 
   if (unsigned np = d->getNumParams()) {
-    this->OS << ">\n";
     for (unsigned i = 0; i < np; ++i) {
       // Use the default argument from the most recent declaration.
       // Clang accumulates the defaults and only the last one has
@@ -2140,59 +3567,56 @@ void ASTVisitor::OutputFunctionHelper(clang::FunctionDecl const* d,
       this->OutputFunctionArgument(d->getParamDecl(i), dn->Complete, def);
     }
     if (d->isVariadic()) {
-      this->OS << "    <Ellipsis/>\n";
+      this->Out.BeginElement("Ellipsis");
+      this->Out.EndElement();
     }
-    this->OS << "  </" << tag << ">\n";
-  } else {
-    this->OS << "/>\n";
   }
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputFunctionTypeHelper(clang::FunctionProtoType const* t,
                                           DumpNode const* dn, char const* tag,
                                           clang::Type const* c)
 {
-  this->OS << "  <" << tag;
+  this->Out.BeginElement(tag);
   this->PrintIdAttribute(dn);
   if (c) {
     this->PrintBaseTypeAttribute(c, dn->Complete);
   }
   this->PrintReturnsAttribute(t->getReturnType(), dn->Complete);
   if (t->isConst()) {
-    this->OS << " const=\"1\"";
+    this->PrintAttribute("const", "1");
   }
   if (t->isVolatile()) {
-    this->OS << " volatile=\"1\"";
+    this->PrintAttribute("volatile", "1");
   }
   if (t->isRestrict()) {
-    this->OS << " restrict=\"1\"";
+    this->PrintAttribute("restrict", "1");
   }
-  std::vector<std::string> attributes;
+  AttributeList attributes;
   this->GetFunctionTypeAttributes(t, attributes);
   this->PrintAttributesAttribute(attributes);
   if (t->param_type_begin() != t->param_type_end()) {
-    this->OS << ">\n";
     for (clang::FunctionProtoType::param_type_iterator
            i = t->param_type_begin(),
            e = t->param_type_end();
          i != e; ++i) {
-      this->OS << "    <Argument";
+      this->Out.BeginElement("Argument");
       this->PrintTypeAttribute(*i, dn->Complete);
-      this->OS << "/>\n";
+      this->Out.EndElement();
     }
     if (t->isVariadic()) {
-      this->OS << "    <Ellipsis/>\n";
+      this->Out.BeginElement("Ellipsis");
+      this->Out.EndElement();
     }
-    this->OS << "  </" << tag << ">\n";
-  } else {
-    this->OS << "/>\n";
   }
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputFunctionArgument(clang::ParmVarDecl const* a,
                                         bool complete, clang::Expr const* def)
 {
-  this->OS << "    <Argument";
+  this->Out.BeginElement("Argument");
   std::string name = a->getName().str();
   if (!name.empty()) {
     this->PrintNameAttribute(name);
@@ -2200,41 +3624,39 @@ void ASTVisitor::OutputFunctionArgument(clang::ParmVarDecl const* a,
   this->PrintTypeAttribute(a->getType(), complete);
 
   if (a->getOriginalType() != a->getType()) {
-    this->OS << " original_type=\"";
+    this->Out.BeginAttribute("original_type");
     this->PrintTypeIdRef(a->getOriginalType(), complete);
-    this->OS << "\"";
+    this->Out.EndAttribute();
   }
 
   this->PrintLocationAttribute(a);
   if (def) {
-    this->OS << " default=\"";
     std::string s;
     llvm::raw_string_ostream rso(s);
     PrinterHelper ph(*this);
     def->printPretty(rso, &ph, this->PrintingPolicy);
-    this->OS << encodeXML(rso.str());
-    this->OS << "\"";
+    this->PrintAttribute("default", rso.str());
   }
   this->PrintAttributesAttribute(a);
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputTranslationUnitDecl(clang::TranslationUnitDecl const* d,
                                            DumpNode const* dn)
 {
-  this->OS << "  <Namespace";
+  this->Out.BeginElement("Namespace");
   this->PrintIdAttribute(dn);
   this->PrintNameAttribute(std::string("::"));
   if (dn->Complete) {
     this->PrintMembersAttribute(d);
   }
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputNamespaceDecl(clang::NamespaceDecl const* d,
                                      DumpNode const* dn)
 {
-  this->OS << "  <Namespace";
+  this->Out.BeginElement("Namespace");
   this->PrintIdAttribute(dn);
   std::string name = d->getName().str();
   if (!name.empty()) {
@@ -2242,14 +3664,14 @@ void ASTVisitor::OutputNamespaceDecl(clang::NamespaceDecl const* d,
   }
   this->PrintContextAttribute(d);
   if (dn->Complete) {
-    std::set<DumpId> emitted;
+    MemberList emitted;
     for (clang::NamespaceDecl const* r : d->redecls()) {
       this->AddDeclContextMembers(r, emitted);
     }
     this->PrintMembersAttribute(emitted);
   }
   this->PrintCommentAttribute(d, dn);
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputRecordDecl(clang::RecordDecl const* d,
@@ -2274,7 +3696,7 @@ void ASTVisitor::OutputRecordDecl(clang::RecordDecl const* d,
   clang::CXXRecordDecl const* dx = clang::dyn_cast<clang::CXXRecordDecl>(d);
   bool doBases = false;
 
-  this->OS << "  <" << tag;
+  this->Out.BeginElement(tag);
   this->PrintIdAttribute(dn);
   if (!d->isAnonymousStructOrUnion() && !d->isLambda()) {
     std::string s;
@@ -2297,7 +3719,13 @@ void ASTVisitor::OutputRecordDecl(clang::RecordDecl const* d,
   this->PrintLocationAttribute(d);
   if (d->getDefinition()) {
     if (dx && dx->isAbstract()) {
-      this->OS << " abstract=\"1\"";
+      this->PrintAttribute("abstract", "1");
+    }
+    if (this->Opts.CastXml && this->Skips && dx) {
+      ImplicitMemberSkips::const_iterator i = this->Skips->find(dx);
+      if (i != this->Skips->end()) {
+        this->PrintAttribute("skipped_implicit_members", i->second);
+      }
     }
     if (dn->Complete && !d->isInvalidDecl() && !d->isLambda()) {
       this->PrintMembersAttribute(d);
@@ -2308,13 +3736,12 @@ void ASTVisitor::OutputRecordDecl(clang::RecordDecl const* d,
       this->PrintBefriendingAttribute(dx);
     }
   } else {
-    this->OS << " incomplete=\"1\"";
+    this->PrintAttribute("incomplete", "1");
   }
   this->PrintABIAttributes(d);
   this->PrintAttributesAttribute(d);
   this->PrintCommentAttribute(d, dn);
   if (doBases) {
-    this->OS << ">\n";
     clang::ASTRecordLayout const& layout = this->CTX.getASTRecordLayout(dx);
     for (clang::CXXRecordDecl::base_class_const_iterator i = dx->bases_begin(),
                                                          e = dx->bases_end();
@@ -2322,20 +3749,18 @@ void ASTVisitor::OutputRecordDecl(clang::RecordDecl const* d,
       clang::QualType bt = i->getType().getCanonicalType();
       clang::CXXRecordDecl const* bd = clang::dyn_cast<clang::CXXRecordDecl>(
         bt->getAs<clang::RecordType>()->getDecl());
-      this->OS << "    <Base";
+      this->Out.BeginElement("Base");
       this->PrintTypeAttribute(bt, true);
       this->PrintAccessAttribute(i->getAccessSpecifier());
-      this->OS << " virtual=\"" << (i->isVirtual() ? 1 : 0) << "\"";
+      this->PrintAttribute("virtual", i->isVirtual() ? "1" : "0");
       if (bd && !i->isVirtual()) {
-        this->OS << " offset=\"" << layout.getBaseClassOffset(bd).getQuantity()
-                 << "\"";
+        this->PrintNumberAttribute(
+          "offset", layout.getBaseClassOffset(bd).getQuantity());
       }
-      this->OS << "/>\n";
+      this->Out.EndElement();
     }
-    this->OS << "  </" << tag << ">\n";
-  } else {
-    this->OS << "/>\n";
   }
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputCXXRecordDecl(clang::CXXRecordDecl const* d,
@@ -2366,7 +3791,7 @@ void ASTVisitor::OutputTypedefDecl(clang::TypedefDecl const* d,
     return;
   }
 
-  this->OS << "  <Typedef";
+  this->Out.BeginElement("Typedef");
   this->PrintIdAttribute(dn);
   this->PrintNameAttribute(d->getName().str());
   this->PrintTypeAttribute(d->getUnderlyingType(), dn->Complete);
@@ -2374,13 +3799,13 @@ void ASTVisitor::OutputTypedefDecl(clang::TypedefDecl const* d,
   this->PrintLocationAttribute(d);
   this->PrintAttributesAttribute(d);
   this->PrintCommentAttribute(d, dn);
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputTypeAliasDecl(clang::TypeAliasDecl const* d,
                                      DumpNode const* dn)
 {
-  this->OS << "  <Typedef";
+  this->Out.BeginElement("Typedef");
   this->PrintIdAttribute(dn);
   this->PrintNameAttribute(d->getName().str());
   this->PrintTypeAttribute(d->getUnderlyingType(), dn->Complete);
@@ -2388,12 +3813,12 @@ void ASTVisitor::OutputTypeAliasDecl(clang::TypeAliasDecl const* d,
   this->PrintLocationAttribute(d);
   this->PrintAttributesAttribute(d);
   this->PrintCommentAttribute(d, dn);
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputEnumDecl(clang::EnumDecl const* d, DumpNode const* dn)
 {
-  this->OS << "  <Enumeration";
+  this->Out.BeginElement("Enumeration");
   this->PrintIdAttribute(dn);
   std::string name = d->getName().str();
   if (name.empty()) {
@@ -2408,7 +3833,7 @@ void ASTVisitor::OutputEnumDecl(clang::EnumDecl const* d, DumpNode const* dn)
   this->PrintContextAttribute(d);
   this->PrintLocationAttribute(d);
   if (this->Opts.CastXml && d->isScoped()) {
-    this->OS << " scoped=\"1\"";
+    this->PrintAttribute("scoped", "1");
   }
   this->PrintABIAttributes(d);
   this->PrintAttributesAttribute(d);
@@ -2416,25 +3841,22 @@ void ASTVisitor::OutputEnumDecl(clang::EnumDecl const* d, DumpNode const* dn)
   clang::EnumDecl::enumerator_iterator enum_begin = d->enumerator_begin();
   clang::EnumDecl::enumerator_iterator enum_end = d->enumerator_end();
   if (enum_begin != enum_end) {
-    this->OS << ">\n";
     for (clang::EnumDecl::enumerator_iterator i = enum_begin; i != enum_end;
          ++i) {
       clang::EnumConstantDecl const* ecd = *i;
-      this->OS << "    <EnumValue";
+      this->Out.BeginElement("EnumValue");
       this->PrintNameAttribute(ecd->getName());
-      this->OS << " init=\"" << ecd->getInitVal() << "\"";
+      this->PrintNumberAttribute("init", ecd->getInitVal());
       this->PrintAttributesAttribute(ecd);
-      this->OS << "/>\n";
+      this->Out.EndElement();
     }
-    this->OS << "  </Enumeration>\n";
-  } else {
-    this->OS << "/>\n";
   }
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputFieldDecl(clang::FieldDecl const* d, DumpNode const* dn)
 {
-  this->OS << "  <Field";
+  this->Out.BeginElement("Field");
   this->PrintIdAttribute(dn);
   this->PrintNameAttribute(d->getName().str());
   this->PrintTypeAttribute(d->getType(), dn->Complete);
@@ -2444,7 +3866,7 @@ void ASTVisitor::OutputFieldDecl(clang::FieldDecl const* d, DumpNode const* dn)
       this->CTX
 #endif
     );
-    this->OS << " bits=\"" << bits << "\"";
+    this->PrintNumberAttribute("bits", bits);
   }
   if (this->Opts.CastXml && !this->IsCastXMLTypedefType(d->getType())) {
     this->PrintInitAttribute(d->getInClassInitializer());
@@ -2453,17 +3875,17 @@ void ASTVisitor::OutputFieldDecl(clang::FieldDecl const* d, DumpNode const* dn)
   this->PrintLocationAttribute(d);
   this->PrintOffsetAttribute(this->CTX.getFieldOffset(d));
   if (d->isMutable()) {
-    this->OS << " mutable=\"1\"";
+    this->PrintAttribute("mutable", "1");
   }
   this->PrintAttributesAttribute(d);
   this->PrintCommentAttribute(d, dn);
 
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputVarDecl(clang::VarDecl const* d, DumpNode const* dn)
 {
-  this->OS << "  <Variable";
+  this->Out.BeginElement("Variable");
   this->PrintIdAttribute(dn);
   this->PrintNameAttribute(d->getName().str());
   this->PrintTypeAttribute(d->getType(), dn->Complete);
@@ -2473,10 +3895,10 @@ void ASTVisitor::OutputVarDecl(clang::VarDecl const* d, DumpNode const* dn)
   this->PrintContextAttribute(d);
   this->PrintLocationAttribute(d);
   if (d->getStorageClass() == clang::SC_Static) {
-    this->OS << " static=\"1\"";
+    this->PrintAttribute("static", "1");
   }
   if (d->getStorageClass() == clang::SC_Extern) {
-    this->OS << " extern=\"1\"";
+    this->PrintAttribute("extern", "1");
   }
 
   bool const isTranslationUnit =
@@ -2488,7 +3910,7 @@ void ASTVisitor::OutputVarDecl(clang::VarDecl const* d, DumpNode const* dn)
   this->PrintAttributesAttribute(d);
   this->PrintCommentAttribute(d, dn);
 
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputFunctionDecl(clang::FunctionDecl const* d,
@@ -2614,11 +4036,11 @@ void ASTVisitor::OutputAtomicType(clang::AtomicType const* t,
     this->OutputUnimplementedType(t, dn);
     return;
   }
-  this->OS << "  <AtomicType";
+  this->Out.BeginElement("AtomicType");
   this->PrintIdAttribute(dn);
   this->PrintTypeAttribute(t->getValueType(), false);
   this->PrintABIAttributes(this->CTX.getTypeInfo(t));
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputAutoType(clang::AutoType const* t, DumpNode const* dn)
@@ -2627,15 +4049,15 @@ void ASTVisitor::OutputAutoType(clang::AutoType const* t, DumpNode const* dn)
     this->OutputUnimplementedType(t, dn);
     return;
   }
-  this->OS << "  <AutoType";
+  this->Out.BeginElement("AutoType");
   this->PrintIdAttribute(dn);
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputBuiltinType(clang::BuiltinType const* t,
                                    DumpNode const* dn)
 {
-  this->OS << "  <FundamentalType";
+  this->Out.BeginElement("FundamentalType");
   this->PrintIdAttribute(dn);
 
   // gccxml used different name variants than Clang for some types
@@ -2669,27 +4091,29 @@ void ASTVisitor::OutputBuiltinType(clang::BuiltinType const* t,
   this->PrintNameAttribute(name);
   this->PrintABIAttributes(this->CTX.getTypeInfo(t));
 
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputConstantArrayType(clang::ConstantArrayType const* t,
                                          DumpNode const* dn)
 {
-  this->OS << "  <ArrayType";
+  this->Out.BeginElement("ArrayType");
   this->PrintIdAttribute(dn);
-  this->OS << " min=\"0\" max=\"" << (t->getSize() - 1) << "\"";
+  this->PrintAttribute("min", "0");
+  this->PrintNumberAttribute("max", t->getSize() - 1);
   this->PrintTypeAttribute(t->getElementType(), dn->Complete);
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputIncompleteArrayType(clang::IncompleteArrayType const* t,
                                            DumpNode const* dn)
 {
-  this->OS << "  <ArrayType";
+  this->Out.BeginElement("ArrayType");
   this->PrintIdAttribute(dn);
-  this->OS << " min=\"0\" max=\"\"";
+  this->PrintAttribute("min", "0");
+  this->PrintAttribute("max", "");
   this->PrintTypeAttribute(t->getElementType(), dn->Complete);
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputFunctionProtoType(clang::FunctionProtoType const* t,
@@ -2701,21 +4125,21 @@ void ASTVisitor::OutputFunctionProtoType(clang::FunctionProtoType const* t,
 void ASTVisitor::OutputLValueReferenceType(clang::LValueReferenceType const* t,
                                            DumpNode const* dn)
 {
-  this->OS << "  <ReferenceType";
+  this->Out.BeginElement("ReferenceType");
   this->PrintIdAttribute(dn);
   this->PrintTypeAttribute(t->getPointeeType(), false);
   this->PrintABIAttributes(this->CTX.getTypeInfo(t));
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputRValueReferenceType(clang::RValueReferenceType const* t,
                                            DumpNode const* dn)
 {
-  this->OS << "  <RValueReferenceType";
+  this->Out.BeginElement("RValueReferenceType");
   this->PrintIdAttribute(dn);
   this->PrintTypeAttribute(t->getPointeeType(), false);
   this->PrintABIAttributes(this->CTX.getTypeInfo(t));
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputMemberPointerType(clang::MemberPointerType const* t,
@@ -2731,11 +4155,11 @@ void ASTVisitor::OutputMemberPointerType(clang::MemberPointerType const* t,
   if (t->isMemberDataPointerType()) {
     this->OutputOffsetType(t->getPointeeType(), c, dn);
   } else {
-    this->OS << "  <PointerType";
+    this->Out.BeginElement("PointerType");
     this->PrintIdAttribute(dn);
     DumpId id = this->AddTypeDumpNode(DumpType(t->getPointeeType(), c), false);
-    this->OS << " type=\"_" << id << "\"";
-    this->OS << "/>\n";
+    this->PrintIdRefAttribute("type", '_', id);
+    this->Out.EndElement();
   }
 }
 
@@ -2748,131 +4172,246 @@ void ASTVisitor::OutputMethodType(clang::FunctionProtoType const* t,
 void ASTVisitor::OutputOffsetType(clang::QualType t, clang::Type const* c,
                                   DumpNode const* dn)
 {
-  this->OS << "  <OffsetType";
+  this->Out.BeginElement("OffsetType");
   this->PrintIdAttribute(dn);
   this->PrintBaseTypeAttribute(c, dn->Complete);
   this->PrintTypeAttribute(t, dn->Complete);
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputPointerType(clang::PointerType const* t,
                                    DumpNode const* dn)
 {
-  this->OS << "  <PointerType";
+  this->Out.BeginElement("PointerType");
   this->PrintIdAttribute(dn);
   this->PrintTypeAttribute(t->getPointeeType(), false);
   this->PrintABIAttributes(this->CTX.getTypeInfo(t));
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 template <typename T>
 void ASTVisitor::OutputElaboratedTypeImpl(T const* t, DumpNode const* dn)
 {
   assert(this->IsElaboratedType(t));
-  this->OS << "  <ElaboratedType";
+  this->Out.BeginElement("ElaboratedType");
   this->PrintIdAttribute(dn);
 
   if (cx::NestedNameSpecifier nns = this->GetElaboratedTypeQualifier(t)) {
     std::string s;
     llvm::raw_string_ostream rso(s);
     cx::deref(nns).print(rso, this->PrintingPolicy);
-    this->OS << " qualifier=\"" << encodeXML(rso.str()) << '"';
+    this->PrintAttribute("qualifier", rso.str());
   }
 
   clang::ElaboratedTypeKeyword k = this->GetElaboratedTypeKeyword(t);
   if (k != cx_ElaboratedTypeKeyword(None)) {
-    this->OS << " keyword=\""
-             << encodeXML(clang::TypeWithKeyword::getKeywordName(k).str())
-             << '"';
+    this->PrintAttribute("keyword", clang::TypeWithKeyword::getKeywordName(k));
   }
 
   this->PrintTypeAttribute(this->GetElaboratedTypeNamed(t), dn->Complete);
-  this->OS << "/>\n";
+  this->Out.EndElement();
 }
 
 void ASTVisitor::OutputStartXMLTags()
 {
-  /* clang-format off */
-  this->OS <<
-    "<?xml version=\"1.0\"?>\n"
-    ;
-  /* clang-format on */
+  typedef std::pair<llvm::StringRef, llvm::StringRef> Attribute;
   if (this->Opts.CastXml) {
     // Start dump with castxml-compatible format.
-    /* clang-format off */
-    this->OS <<
-      "<CastXML format=\"" << Opts.CastXmlEpicFormatVersion << ".4.0\">\n"
-      ;
-    /* clang-format on */
+    std::string format =
+      std::to_string(this->Opts.CastXmlEpicFormatVersion) + ".4.0";
+    Attribute const attributes[] = { { "format", format } };
+    this->Out.BeginDocument("CastXML", attributes);
   } else if (this->Opts.GccXml) {
     // Start dump with gccxml-compatible format (legacy).
-    /* clang-format off */
-    this->OS <<
-      "<GCC_XML version=\"0.9.0\" cvs_revision=\"1.145\">\n"
-      ;
-    /* clang-format on */
+    Attribute const attributes[] = { { "version", "0.9.0" },
+                                     { "cvs_revision", "1.145" } };
+    this->Out.BeginDocument("GCC_XML", attributes);
   }
 }
 
 void ASTVisitor::OutputEndXMLTags()
 {
   // Finish dump.
-  if (this->Opts.CastXml) {
-    /* clang-format off */
-    this->OS <<
-      "</CastXML>\n"
-      ;
-    /* clang-format on */
-  } else if (this->Opts.GccXml) {
-    /* clang-format off */
-    this->OS <<
-      "</GCC_XML>\n"
-      ;
-    /* clang-format on */
+  if (this->Opts.CastXml || this->Opts.GccXml) {
+    this->Out.EndDocument();
   }
 }
 
 void ASTVisitor::LookupStart(clang::DeclContext const* dc,
-                             std::string const& name)
+                             std::string const& name,
+                             std::vector<clang::Decl const*>& starts)
+{
+  // Resolve one name component at a time for all candidate contexts.
+  // Component lookups are memoized so that start names sharing a
+  // qualified prefix, and contexts reached through several using
+  // directives, are resolved only once.
+  std::vector<std::string> components = NamePatternSet::splitName(name);
+  std::vector<clang::DeclContext const*> contexts(1, dc);
+  for (size_t i = 0; i < components.size() && !contexts.empty(); ++i) {
+    bool const last = (i + 1) == components.size();
+    std::vector<clang::DeclContext const*> next;
+    std::set<clang::DeclContext const*> seen;
+    for (clang::DeclContext const* c : contexts) {
+      for (clang::NamedDecl const* n :
+           this->LookupStartComponent(c, components[i])) {
+        if (last) {
+          starts.push_back(n);
+        } else if (clang::DeclContext const* idc =
+                     clang::dyn_cast<clang::DeclContext const>(n)) {
+          if (seen.insert(idc->getPrimaryContext()).second) {
+            next.push_back(idc);
+          }
+        }
+      }
+    }
+    contexts.swap(next);
+  }
+}
+
+std::vector<clang::NamedDecl const*> const& ASTVisitor::LookupStartComponent(
+  clang::DeclContext const* dc, std::string const& component)
 {
-  std::string::size_type pos = name.find("::");
-  std::string cur = name.substr(0, pos);
+  dc = dc->getPrimaryContext();
+  StartLookupMap::key_type key(dc, component);
+  StartLookupMap::iterator i = this->StartLookups.find(key);
+  if (i != this->StartLookups.end()) {
+    return i->second;
+  }
+  std::vector<clang::NamedDecl const*>& result = this->StartLookups[key];
+
+  // Look in the context itself and then in namespaces it nominates.
+  std::vector<clang::DeclContext const*> contexts(1, dc);
+  std::vector<clang::DeclContext const*> const& usings =
+    this->GetUsingClosure(dc);
+  contexts.insert(contexts.end(), usings.begin(), usings.end());
 
   clang::IdentifierTable& ids = CI.getPreprocessor().getIdentifierTable();
-  auto const& result = dc->lookup(clang::DeclarationName(&ids.get(cur)));
-  if (pos == name.npos) {
-    for (clang::NamedDecl const* n : result) {
-      this->AddStartDecl(n);
+  bool const glob = NamePatternSet::hasGlob(component);
+  std::set<clang::NamedDecl const*> found;
+  for (clang::DeclContext const* c : contexts) {
+    std::vector<std::string> names;
+    if (glob) {
+      std::set<std::string> seen;
+      this->MatchStartNames(c, component, names, seen);
+    } else {
+      names.push_back(component);
+    }
+    for (std::string const& name : names) {
+      for (clang::NamedDecl const* n :
+           c->lookup(clang::DeclarationName(&ids.get(name)))) {
+        if (found.insert(n).second) {
+          result.push_back(n);
+        }
+      }
+    }
+  }
+  return result;
+}
+
+void ASTVisitor::MatchStartNames(clang::DeclContext const* dc,
+                                 llvm::StringRef glob,
+                                 std::vector<std::string>& names,
+                                 std::set<std::string>& seen)
+{
+  // Visit every redeclaration of a namespace in declaration order.
+  std::vector<clang::DeclContext const*> contexts;
+  if (clang::NamespaceDecl const* nd =
+        clang::dyn_cast<clang::NamespaceDecl>(dc)) {
+    for (clang::NamespaceDecl const* r : nd->redecls()) {
+      contexts.push_back(r);
     }
   } else {
-    std::string rest = name.substr(pos + 2);
-    for (clang::NamedDecl const* n : result) {
-      if (clang::DeclContext const* idc =
-            clang::dyn_cast<clang::DeclContext const>(n)) {
-        this->LookupStart(idc, rest);
+    contexts.push_back(dc);
+  }
+
+  for (clang::DeclContext const* c : contexts) {
+    for (clang::Decl const* d : c->decls()) {
+      if (clang::NamedDecl const* n = clang::dyn_cast<clang::NamedDecl>(d)) {
+        if (n->getDeclName().isIdentifier() &&
+            NamePatternSet::matchGlob(glob, n->getName()) &&
+            seen.insert(n->getName().str()).second) {
+          names.push_back(n->getName().str());
+        }
+      }
+      // Members of transparent contexts are visible in this one.
+      if (clang::DeclContext const* tdc =
+            clang::dyn_cast<clang::DeclContext>(d)) {
+        if (tdc->isTransparentContext()) {
+          this->MatchStartNames(tdc, glob, names, seen);
+        }
       }
     }
   }
+}
+
+std::vector<clang::DeclContext const*> const& ASTVisitor::GetUsingClosure(
+  clang::DeclContext const* dc)
+{
+  dc = dc->getPrimaryContext();
+  UsingClosureMap::iterator i = this->UsingClosures.find(dc);
+  if (i != this->UsingClosures.end()) {
+    return i->second;
+  }
+  // The seen set also guards against cycles of using directives.
+  std::vector<clang::DeclContext const*> closure;
+  std::set<clang::DeclContext const*> seen;
+  seen.insert(dc);
+  this->CollectUsingClosure(dc, closure, seen);
+  return this->UsingClosures[dc] = std::move(closure);
+}
 
+void ASTVisitor::CollectUsingClosure(
+  clang::DeclContext const* dc,
+  std::vector<clang::DeclContext const*>& closure,
+  std::set<clang::DeclContext const*>& seen)
+{
   for (clang::UsingDirectiveDecl const* i : dc->using_directives()) {
-    this->LookupStart(i->getNominatedNamespace(), name);
+    clang::DeclContext const* ndc =
+      i->getNominatedNamespace()->getPrimaryContext();
+    if (seen.insert(ndc).second) {
+      closure.push_back(ndc);
+      this->CollectUsingClosure(ndc, closure, seen);
+    }
   }
 }
 
 void ASTVisitor::HandleTranslationUnit(clang::TranslationUnitDecl const* tu)
 {
-  // Add the starting nodes for the dump.
+  // Find the starting declarations for the dump.
+  std::vector<clang::Decl const*> starts;
   if (!this->Opts.StartNames.empty()) {
     // Use the specified starting locations.
     for (std::vector<std::string>::const_iterator
            i = this->Opts.StartNames.begin(),
            e = this->Opts.StartNames.end();
          i != e; ++i) {
-      this->LookupStart(tu, *i);
+      this->LookupStart(tu, *i, starts);
     }
   } else {
     // No start specified.  Use whole translation unit.
-    this->AddStartDecl(tu);
+    starts.push_back(tu);
+  }
+
+  // Record all of them before adding any node so that the shard of
+  // each node does not depend on the order of the start names.
+  if (this->Shards) {
+    for (clang::Decl const* d : starts) {
+      this->AddShardStartDecl(d);
+    }
+  }
+
+  // Add the starting nodes for the dump.
+  for (clang::Decl const* d : starts) {
+    this->AddStartDecl(d);
+  }
+
+  // Add the unity headers so that other files may refer to them.
+  if (this->Unity) {
+    for (clang::FileID fid : this->Unity->getHeaders()) {
+      if (cx::OptionalFileEntryRef f = this->getFileEntryRefForID(fid)) {
+        this->UnityFileIds.push_back(this->AddDumpFile(*f));
+      }
+    }
   }
 
   // Dump opening tags.
@@ -2899,8 +4438,43 @@ void ASTVisitor::HandleTranslationUnit(clang::TranslationUnitDecl const* tu)
 }
 
 void outputXML(clang::CompilerInstance& ci, clang::ASTContext& ctx,
-               llvm::raw_ostream& os, Options const& opts)
+               llvm::raw_ostream& os, Options const& opts,
+               llvm::raw_ostream* index, UnityIncludes const* unity,
+               ImplicitMemberSkips const* skips)
+{
+  std::unique_ptr<ShardWriter> shards;
+  if (!opts.ShardBy.empty()) {
+    // Name shard files after the output file.
+    clang::FrontendOptions const& fo = ci.getFrontendOpts();
+    std::string base = fo.OutputFile;
+    if (base.empty() || base == "-") {
+      llvm::SmallString<128> file(
+        llvm::sys::path::filename(fo.Inputs[0].getFile()));
+      llvm::sys::path::replace_extension(file, "xml");
+      base = std::string(file.str());
+    }
+    shards.reset(new ShardWriter(ci, base));
+  }
+
+  std::unique_ptr<HashWriter> hashes;
+  if (opts.Hashes) {
+    hashes.reset(new HashWriter(os));
+  }
+
+  llvm::raw_ostream& out = shards ? *shards : hashes ? *hashes : os;
+  XMLWriter writer(out, shards.get(), hashes.get(), index);
+  ASTVisitor v(ci, ctx, writer, opts, index, shards.get(), unity, skips);
+  v.HandleTranslationUnit(ctx.getTranslationUnitDecl());
+
+  if (shards) {
+    shards->Finish(os, opts.ShardBy);
+  }
+}
+
+void outputNodes(clang::CompilerInstance& ci, clang::ASTContext& ctx,
+                 OutputSink& sink, Options const& opts,
+                 UnityIncludes const* unity, ImplicitMemberSkips const* skips)
 {
-  ASTVisitor v(ci, ctx, os, opts);
+  ASTVisitor v(ci, ctx, sink, opts, nullptr, nullptr, unity, skips);
   v.HandleTranslationUnit(ctx.getTranslationUnitDecl());
 }
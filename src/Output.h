@@ -20,15 +20,84 @@ namespace llvm {
 class raw_ostream;
 }
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <utility>
+
 namespace clang {
 class CompilerInstance;
 class ASTContext;
+class CXXRecordDecl;
 }
 
 struct Options;
+class UnityIncludes;
+
+/// ImplicitMemberSkips - Class definitions to which implicit members
+/// were not added because a budget was used up, and the name of the
+/// budget.
+typedef std::map<clang::CXXRecordDecl const*, char const*>
+  ImplicitMemberSkips;
+
+/// OutputSink - Receive the output as a document element holding one
+/// element per node.  An element is begun, given its attributes, given
+/// its child elements, if any, and ended.  An attribute value is built
+/// from pieces of text and the ids of elements.
+class OutputSink
+{
+public:
+  virtual ~OutputSink() = default;
+
+  /// Begin the document element with its attributes.
+  virtual void BeginDocument(
+    llvm::StringRef name,
+    llvm::ArrayRef<std::pair<llvm::StringRef, llvm::StringRef>>
+      attributes) = 0;
+
+  /// End the document element after its last element.
+  virtual void EndDocument() = 0;
+
+  /// Begin an element, or a child element of the element not yet ended.
+  virtual void BeginElement(llvm::StringRef name) = 0;
 
-/// outputXML - Print a gccxml-compatible AST dump.
+  /// End the element begun last.
+  virtual void EndElement() = 0;
+
+  /// Begin an attribute of the element begun last.
+  virtual void BeginAttribute(llvm::StringRef name) = 0;
+
+  /// End the attribute begun last.
+  virtual void EndAttribute() = 0;
+
+  /// Append text to the value of the attribute.
+  virtual void Text(llvm::StringRef text) = 0;
+
+  /// Append the id of the element to the value of its id attribute.
+  virtual void Id(llvm::StringRef id) = 0;
+
+  /// Append a reference to the id of another element to the value of
+  /// the attribute.
+  virtual void Ref(llvm::StringRef id) = 0;
+};
+
+/// outputXML - Print a gccxml-compatible AST dump.  If an index
+/// stream is given, write the byte range of each element to it.
+/// If unity inclusions are given, list on each file the headers
+/// from which it was reached.  If implicit member skips are given,
+/// mark the skipped classes.
 void outputXML(clang::CompilerInstance& ci, clang::ASTContext& ctx,
-               llvm::raw_ostream& os, Options const& opts);
+               llvm::raw_ostream& os, Options const& opts,
+               llvm::raw_ostream* index = nullptr,
+               UnityIncludes const* unity = nullptr,
+               ImplicitMemberSkips const* skips = nullptr);
+
+/// outputNodes - Send the AST dump to a sink instead of printing it.
+/// Unity inclusions and implicit member skips are as for outputXML.
+void outputNodes(clang::CompilerInstance& ci, clang::ASTContext& ctx,
+                 OutputSink& sink, Options const& opts,
+                 UnityIncludes const* unity = nullptr,
+                 ImplicitMemberSkips const* skips = nullptr);
 
 #endif // CASTXML_OUTPUT_H
@@ -15,8 +15,12 @@
 */
 
 #include "RunClang.h"
+#include "Delta.h"
+#include "FileCache.h"
 #include "Options.h"
+#include "Order.h"
 #include "Output.h"
+#include "Unity.h"
 #include "Utils.h"
 
 #include "llvm/Config/llvm-config.h"
@@ -42,11 +46,14 @@
 #include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Frontend/Utils.h"
 #include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/PreprocessorOptions.h"
 #include "clang/Sema/Sema.h"
+#include "clang/Serialization/ASTWriter.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Option/ArgList.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -58,15 +65,18 @@
 #  define CASTXML_CLANG_OPTIONS clang::driver::options
 #endif
 
-#if LLVM_VERSION_MAJOR >= 20
+#if LLVM_VERSION_MAJOR >= 9
 #  include "llvm/Support/VirtualFileSystem.h"
 #endif
 
+#include <chrono>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <queue>
+#include <sstream>
+#include <thread>
 
 #if LLVM_VERSION_MAJOR > 3 ||                                                 \
   LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR >= 9
@@ -79,6 +89,43 @@
 #  define CASTXML_MAKE_UNIQUE llvm::make_unique
 #endif
 
+// Read a string in place through a std::istream.
+class StringStreamBuf : public std::streambuf
+{
+public:
+  StringStreamBuf(std::string& s)
+  {
+    this->setg(&s[0], &s[0], &s[0] + s.size());
+  }
+};
+
+// Write through a std::ostream directly to a raw_ostream.
+class RawOStreamBuf : public std::streambuf
+{
+  llvm::raw_ostream& OS;
+
+public:
+  RawOStreamBuf(llvm::raw_ostream& os)
+    : OS(os)
+  {
+  }
+
+protected:
+  int_type overflow(int_type c) override
+  {
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      this->OS << traits_type::to_char_type(c);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(char const* s, std::streamsize n) override
+  {
+    this->OS.write(s, static_cast<size_t>(n));
+    return n;
+  }
+};
+
 class ASTConsumer : public clang::ASTConsumer
 {
   clang::CompilerInstance& CI;
@@ -87,35 +134,53 @@ class ASTConsumer : public clang::ASTConsumer
 #endif
   llvm::raw_ostream& OS;
   Options const& Opts;
+  UnityIncludes* Unity;
   struct Class
   {
     clang::CXXRecordDecl* RD;
-    int Depth;
-    Class(clang::CXXRecordDecl* rd, int depth)
+    unsigned int Depth;
+    Class(clang::CXXRecordDecl* rd, unsigned int depth)
       : RD(rd)
       , Depth(depth)
     {
     }
   };
   std::queue<Class> Classes;
-  int ClassImplicitMemberDepth = 0;
+  unsigned int ClassImplicitMemberDepth = 0;
+
+  // Classes over the implicit member budget, and the budget used.
+  ImplicitMemberSkips Skips;
+  std::vector<clang::CXXRecordDecl const*> SkipOrder;
+  unsigned int ImplicitMemberClasses = 0;
+  std::chrono::steady_clock::time_point ImplicitMemberStart;
+
+  // The finished translation unit waiting for output, if any.
+  clang::ASTContext* Context = nullptr;
+
+  // State of the '--castxml-max-rss' limit.
+  char const* Phase = "while parsing";
+  unsigned int RSSPolls = 0;
+  bool OverMaxRSS = false;
 
 public:
 #ifdef CASTXML_OWNS_OSTREAM
   ASTConsumer(clang::CompilerInstance& ci,
-              std::unique_ptr<llvm::raw_ostream> os, Options const& opts)
+              std::unique_ptr<llvm::raw_ostream> os, Options const& opts,
+              UnityIncludes* unity)
     : CI(ci)
     , OwnOS(std::move(os))
     , OS(*OwnOS)
     , Opts(opts)
+    , Unity(unity)
   {
   }
 #else
   ASTConsumer(clang::CompilerInstance& ci, llvm::raw_ostream& os,
-              Options const& opts)
+              Options const& opts, UnityIncludes* unity)
     : CI(ci)
     , OS(os)
     , Opts(opts)
+    , Unity(unity)
   {
   }
 #endif
@@ -166,17 +231,109 @@ public:
     }
   }
 
+  /** Check the resident set size against '--castxml-max-rss'.
+      Reports a fatal error and returns false if it is exceeded.  */
+  bool CheckMaxRSS()
+  {
+    if (this->OverMaxRSS) {
+      return false;
+    }
+    if (!this->Opts.MaxRSS) {
+      return true;
+    }
+    unsigned long long const mib = getResidentSetSize() >> 20;
+    if (mib <= this->Opts.MaxRSS) {
+      return true;
+    }
+    this->OverMaxRSS = true;
+    std::ostringstream msg;
+    msg << "resident set size of " << mib
+        << " MiB exceeds '--castxml-max-rss' limit of " << this->Opts.MaxRSS
+        << " MiB " << this->Phase;
+    this->ReportError(msg.str(), clang::DiagnosticsEngine::Fatal);
+    return false;
+  }
+
+  /** Check the resident set size on every few calls.  */
+  bool PollMaxRSS()
+  {
+    if (this->Opts.MaxRSS && ++this->RSSPolls % 64 == 0) {
+      return this->CheckMaxRSS();
+    }
+    return !this->OverMaxRSS;
+  }
+
+  bool HandleTopLevelDecl(clang::DeclGroupRef)
+  {
+    // Stop parsing once the limit is exceeded.
+    return this->PollMaxRSS();
+  }
+
   void HandleTagDeclDefinition(clang::TagDecl* d)
   {
+    this->PollMaxRSS();
     if (clang::CXXRecordDecl* rd = clang::dyn_cast<clang::CXXRecordDecl>(d)) {
       if (!rd->isDependentContext()) {
-        if (this->ClassImplicitMemberDepth < 16) {
+        if (this->ClassImplicitMemberDepth < this->Opts.ImplicitMemberDepth) {
           this->Classes.push(Class(rd, this->ClassImplicitMemberDepth));
+        } else {
+          this->SkipImplicitMembers(rd, "depth");
         }
       }
     }
   }
 
+  void SkipImplicitMembers(clang::CXXRecordDecl const* rd, char const* budget)
+  {
+    if (this->Skips.emplace(rd, budget).second) {
+      this->SkipOrder.push_back(rd);
+    }
+  }
+
+  /** Get the implicit member budget used up before adding implicit
+      members to another class, if any.  */
+  char const* ImplicitMemberBudgetUsed()
+  {
+    if (this->ImplicitMemberClasses >= this->Opts.ImplicitMemberClasses) {
+      return "classes";
+    }
+    if (this->Opts.ImplicitMemberTime != ~0u &&
+        std::chrono::steady_clock::now() - this->ImplicitMemberStart >=
+          std::chrono::milliseconds(this->Opts.ImplicitMemberTime)) {
+      return "ms";
+    }
+    return nullptr;
+  }
+
+  /** Get the skipped classes to mark in the output.  They are marked
+      only when the budget was asked for explicitly so that output with
+      the default depth is unchanged.  */
+  ImplicitMemberSkips const* MarkedSkips() const
+  {
+    if (this->Opts.HaveImplicitMemberBudget ||
+        !this->Opts.ImplicitMemberReport.empty()) {
+      return &this->Skips;
+    }
+    return nullptr;
+  }
+
+  void WriteImplicitMemberReport()
+  {
+    std::unique_ptr<llvm::raw_fd_ostream> os =
+      this->OpenOutputFile(this->Opts.ImplicitMemberReport);
+    if (!os) {
+      return;
+    }
+    clang::PrintingPolicy policy =
+      this->CI.getASTContext().getPrintingPolicy();
+    policy.SuppressUnwrittenScope = true;
+    for (clang::CXXRecordDecl const* rd : this->SkipOrder) {
+      *os << this->Skips[rd] << ' ';
+      rd->getNameForDiagnostic(*os, policy, true);
+      *os << '\n';
+    }
+  }
+
   void HandleTranslationUnit(clang::ASTContext& ctx)
   {
     clang::Sema& sema = this->CI.getSema();
@@ -184,24 +341,225 @@ public:
     // Perform instantiations needed by the original translation unit.
     sema.PerformPendingInstantiations();
 
-    if (!sema.getDiagnostics().hasErrorOccurred()) {
+    if (!sema.getDiagnostics().hasErrorOccurred() && this->CheckMaxRSS()) {
       // Suppress diagnostics from below extensions to the translation unit.
       sema.getDiagnostics().setSuppressAllDiagnostics(true);
 
-      // Add implicit members to classes.
-      while (!this->Classes.empty()) {
+      // Add implicit members to classes within the budget.
+      this->Phase = "while adding implicit members";
+      this->ImplicitMemberStart = std::chrono::steady_clock::now();
+      while (!this->Classes.empty() && this->PollMaxRSS()) {
         Class c = this->Classes.front();
         this->Classes.pop();
+        if (char const* budget = this->ImplicitMemberBudgetUsed()) {
+          this->SkipImplicitMembers(c.RD, budget);
+          continue;
+        }
+        ++this->ImplicitMemberClasses;
         this->AddImplicitMembers(c);
       }
     }
 
     // Tell Clang to finish the translation unit and tear down the parser.
     sema.ActOnEndOfTranslationUnit();
+    if (this->OverMaxRSS) {
+      return;
+    }
+
+#if LLVM_VERSION_MAJOR >= 9
+    // Save the finished AST for later runs with '--castxml-from-ast'.
+    if (!this->Opts.EmitAST.empty()) {
+      this->EmitAST(sema);
+    }
+#endif
+
+    // Find the unity headers from which each file was reached.
+    if (this->Unity) {
+      this->Unity->Finish(this->CI.getSourceManager());
+    }
+
+    if (!this->Opts.ImplicitMemberReport.empty()) {
+      this->WriteImplicitMemberReport();
+    }
+
+    // Output is written by Finish once the parser has been destroyed.
+    this->Context = &ctx;
+  }
+
+  /** Write the output for the finished translation unit.  Called
+      after parsing returns so that the parser is already gone.  */
+  void Finish()
+  {
+    clang::ASTContext* ctx = this->Context;
+    if (!ctx) {
+      return;
+    }
+    this->Context = nullptr;
+
+    // Output needs only the AST, the source manager, and the
+    // preprocessor that owns the identifier tables.  Release the
+    // semantic analysis state to lower the peak memory of output.
+    this->CI.takeSema().reset();
+
+    this->Phase = "before writing output";
+    if (!this->CheckMaxRSS()) {
+      return;
+    }
 
     // Process the AST.
-    outputXML(this->CI, ctx, this->OS, this->Opts);
+    this->OutputXML(*ctx, this->OS, this->Opts);
+
+    // Process the AST again for each query.  The visitor may create
+    // types in the ASTContext, so queries cannot run concurrently.
+    for (Options::Query const& q : this->Opts.Queries) {
+      this->OutputQuery(*ctx, q);
+    }
+  }
+
+  std::unique_ptr<llvm::raw_fd_ostream> OpenOutputFile(
+    std::string const& file)
+  {
+    std::error_code ec;
+    std::unique_ptr<llvm::raw_fd_ostream> os(new llvm::raw_fd_ostream(
+      file, ec,
+#if LLVM_VERSION_MAJOR >= 9
+      llvm::sys::fs::OF_None
+#else
+      llvm::sys::fs::F_None
+#endif
+      ));
+    if (ec) {
+      // Diagnostics may have been suppressed for implicit members above.
+      clang::DiagnosticsEngine& diags = this->CI.getDiagnostics();
+      diags.setSuppressAllDiagnostics(false);
+      diags.Report(clang::diag::err_fe_unable_to_open_output)
+        << file << ec.message();
+      os.reset();
+    }
+    return os;
+  }
+
+  void OutputQuery(clang::ASTContext& ctx, Options::Query const& q)
+  {
+    std::unique_ptr<llvm::raw_fd_ostream> os =
+      this->OpenOutputFile(q.OutputFile);
+    if (!os) {
+      return;
+    }
+    Options opts = this->Opts;
+    opts.StartNames = q.StartNames;
+    opts.Queries.clear();
+    opts.Delta.clear();
+    opts.IndexFile.clear();
+    opts.ShardBy.clear();
+    opts.Sink = nullptr;
+    this->OutputXML(ctx, *os, opts);
+  }
+
+  void OutputXML(clang::ASTContext& ctx, llvm::raw_ostream& os,
+                 Options const& opts)
+  {
+    if (opts.Sink) {
+      outputNodes(this->CI, ctx, *opts.Sink, opts, this->Unity,
+                  this->MarkedSkips());
+      return;
+    }
+
+    if (!opts.DependencyOrder && opts.Delta.empty()) {
+      std::unique_ptr<llvm::raw_fd_ostream> index;
+      if (!opts.IndexFile.empty()) {
+        index = this->OpenOutputFile(opts.IndexFile);
+        if (!index) {
+          return;
+        }
+      }
+      outputXML(this->CI, ctx, os, opts, index.get(), this->Unity,
+                this->MarkedSkips());
+      return;
+    }
+
+    // Order and differences are computed from the finished output.
+    std::string xml;
+    {
+      llvm::raw_string_ostream xos(xml);
+      outputXML(this->CI, ctx, xos, opts, nullptr, this->Unity,
+                this->MarkedSkips());
+    }
+
+    std::string error;
+    if (opts.DependencyOrder) {
+      std::ostringstream ordered;
+      if (!writeXMLInDependencyOrder(xml, ordered, error)) {
+        this->ReportError("cannot order elements: " + error);
+        return;
+      }
+      xml = ordered.str();
+    }
+
+    if (opts.Delta.empty()) {
+      os << xml;
+      return;
+    }
+
+    // Read the output in place and write only the differences from the
+    // previous output, of which just a digest per element is kept.
+    std::ifstream previous(opts.Delta.c_str(),
+                           std::ios::in | std::ios::binary);
+    if (!previous) {
+      error = "cannot open file";
+    } else {
+      StringStreamBuf currentBuf(xml);
+      std::istream current(&currentBuf);
+      RawOStreamBuf outBuf(os);
+      std::ostream out(&outBuf);
+      writeXMLDelta(current, previous, out, error);
+    }
+    if (!error.empty()) {
+      this->ReportError("cannot compare with '" + opts.Delta + "': " + error);
+    }
   }
+
+  void ReportError(std::string const& msg,
+                   clang::DiagnosticsEngine::Level level =
+                     clang::DiagnosticsEngine::Error)
+  {
+    // Diagnostics may have been suppressed for implicit members above.
+    clang::DiagnosticsEngine& diags = this->CI.getDiagnostics();
+    diags.setSuppressAllDiagnostics(false);
+    diags.Report(diags.getCustomDiagID(level, "%0")) << msg;
+  }
+
+#if LLVM_VERSION_MAJOR >= 9
+  void EmitAST(clang::Sema& sema)
+  {
+    // Do not save an AST that failed to compile.
+    if (sema.getDiagnostics().hasErrorOccurred()) {
+      return;
+    }
+
+    llvm::SmallVector<char, 0> buffer;
+    {
+      llvm::BitstreamWriter stream(buffer);
+      clang::ASTWriter writer(stream, buffer, this->CI.getModuleCache(),
+#  if LLVM_VERSION_MAJOR >= 21
+                              this->CI.getCodeGenOpts(),
+#  endif
+                              {});
+      writer.WriteAST(
+#  if LLVM_VERSION_MAJOR >= 20
+        &sema,
+#  else
+        sema,
+#  endif
+        this->Opts.EmitAST, nullptr, "");
+    }
+
+    if (std::unique_ptr<llvm::raw_fd_ostream> os =
+          this->OpenOutputFile(this->Opts.EmitAST)) {
+      os->write(buffer.data(), buffer.size());
+    }
+  }
+#endif
 };
 
 #define UNDEF_FLT(x)                                                          \
@@ -680,20 +1038,51 @@ public:
 class CastXMLSyntaxOnlyAction
   : public CastXMLPredefines<clang::SyntaxOnlyAction>
 {
+#ifndef CASTXML_OWNS_OSTREAM
+  std::unique_ptr<llvm::raw_ostream> NullOS;
+#endif
+  UnityIncludes Unity;
+  ASTConsumer* Consumer = nullptr;
+
+  std::unique_ptr<clang::ASTConsumer> KeepConsumer(
+    std::unique_ptr<ASTConsumer> consumer)
+  {
+    this->Consumer = consumer.get();
+    return std::move(consumer);
+  }
+
+  UnityIncludes* GetUnity()
+  {
+    return this->Opts.UnityHeaders.empty() ? nullptr : &this->Unity;
+  }
+
   std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
     clang::CompilerInstance& CI, llvm::StringRef InFile) override
   {
     using llvm::sys::path::filename;
     if (!this->Opts.GccXml && !this->Opts.CastXml) {
       return clang::SyntaxOnlyAction::CreateASTConsumer(CI, InFile);
+    } else if (this->Opts.Sink) {
+      // The output goes to the caller's sink, not to a stream.
+      std::unique_ptr<llvm::raw_ostream> OS(new llvm::raw_null_ostream);
+#ifdef CASTXML_OWNS_OSTREAM
+      return this->KeepConsumer(CASTXML_MAKE_UNIQUE<ASTConsumer>(
+        CI, std::move(OS), this->Opts, this->GetUnity()));
+#else
+      this->NullOS = std::move(OS);
+      return this->KeepConsumer(CASTXML_MAKE_UNIQUE<ASTConsumer>(
+        CI, *this->NullOS, this->Opts, this->GetUnity()));
+#endif
 #ifdef CASTXML_OWNS_OSTREAM
     } else if (std::unique_ptr<llvm::raw_ostream> OS =
                  CI.createDefaultOutputFile(false, filename(InFile), "xml")) {
-      return CASTXML_MAKE_UNIQUE<ASTConsumer>(CI, std::move(OS), this->Opts);
+      return this->KeepConsumer(CASTXML_MAKE_UNIQUE<ASTConsumer>(
+        CI, std::move(OS), this->Opts, this->GetUnity()));
 #else
     } else if (llvm::raw_ostream* OS =
                  CI.createDefaultOutputFile(false, filename(InFile), "xml")) {
-      return CASTXML_MAKE_UNIQUE<ASTConsumer>(CI, *OS, this->Opts);
+      return this->KeepConsumer(CASTXML_MAKE_UNIQUE<ASTConsumer>(
+        CI, *OS, this->Opts, this->GetUnity()));
 #endif
     } else {
       return nullptr;
@@ -719,9 +1108,26 @@ protected:
     // We need it in ASTConsumer::HandleTranslationUnit.
     CI.getPreprocessor().enableIncrementalProcessing();
 
+    // Record the headers from which each file is reached.
+    if (UnityIncludes* unity = this->GetUnity()) {
+      CI.getPreprocessor().addPPCallbacks(
+        unity->CreateCallbacks(CI.getSourceManager()));
+    }
+
     return true;
   }
 
+  void ExecuteAction() override
+  {
+    this->CastXMLPredefines::ExecuteAction();
+
+    // Write output now that parsing has returned and the parser
+    // has been destroyed.
+    if (this->Consumer) {
+      this->Consumer->Finish();
+    }
+  }
+
 public:
   CastXMLSyntaxOnlyAction(Options const& opts)
     : CastXMLPredefines(opts)
@@ -730,7 +1136,8 @@ public:
 };
 
 static clang::FrontendAction* CreateFrontendAction(clang::CompilerInstance* CI,
-                                                   Options const& opts)
+                                                   Options const& opts,
+                                                   llvm::raw_ostream& errs)
 {
   clang::frontend::ActionKind action =
     CI->getInvocation().getFrontendOpts().ProgramAction;
@@ -740,7 +1147,7 @@ static clang::FrontendAction* CreateFrontendAction(clang::CompilerInstance* CI,
     case clang::frontend::ParseSyntaxOnly:
       return new CastXMLSyntaxOnlyAction(opts);
     default:
-      std::cerr << "error: unsupported action: " << int(action) << "\n";
+      errs << "error: unsupported action: " << int(action) << "\n";
       return nullptr;
   }
 }
@@ -754,25 +1161,95 @@ static bool isObjC(clang::CompilerInstance* CI)
 #endif
 }
 
-static bool runClangCI(clang::CompilerInstance* CI, Options const& opts)
+#if LLVM_VERSION_MAJOR >= 9
+static llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> createVirtualFiles(
+  Options const& opts, llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> baseFS,
+  llvm::raw_ostream& errs)
 {
+  // Layer the virtual files over the base file system.  Relative paths
+  // of both are interpreted relative to the current working directory.
+  llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> memoryFS(
+    new llvm::vfs::InMemoryFileSystem);
+  llvm::SmallString<256> cwd;
+  if (!llvm::sys::fs::current_path(cwd)) {
+    memoryFS->setCurrentWorkingDirectory(cwd);
+  }
+  for (Options::VirtualFile const& vf : opts.VirtualFiles) {
+    if (!memoryFS->addFile(
+          vf.Path, 0,
+          llvm::MemoryBuffer::getMemBufferCopy(vf.Contents, vf.Path))) {
+      errs << "error: cannot add virtual file '" << vf.Path << "'\n";
+      return nullptr;
+    }
+  }
+  llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> overlayFS(
+    new llvm::vfs::OverlayFileSystem(baseFS));
+  overlayFS->pushOverlay(memoryFS);
+  return overlayFS;
+}
+#endif
+
+static bool runClangCI(clang::CompilerInstance* CI, Options const& opts,
+                       llvm::raw_ostream& errs
+#if LLVM_VERSION_MAJOR >= 9
+                       ,
+                       llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> vfs
+#endif
+)
+{
+#if LLVM_VERSION_MAJOR >= 22
+  if (vfs) {
+    CI->createVirtualFileSystem(vfs);
+  }
+#endif
+
   // Create a diagnostics engine for this compiler instance.
   CI->createDiagnostics(
 #if LLVM_VERSION_MAJOR >= 20 && LLVM_VERSION_MAJOR < 22
-    *llvm::vfs::getRealFileSystem()
+    vfs ? *vfs : *llvm::vfs::getRealFileSystem(),
 #endif
-  );
+    new clang::TextDiagnosticPrinter(errs,
+#if LLVM_VERSION_MAJOR >= 21
+                                     CI->getDiagnosticOpts()
+#else
+                                     &CI->getDiagnosticOpts()
+#endif
+                                     ));
   if (!CI->hasDiagnostics()) {
     return false;
   }
 
+#if LLVM_VERSION_MAJOR >= 9 && LLVM_VERSION_MAJOR < 22
+  if (vfs) {
+    // Read files through the virtual files, honoring any '-ivfsoverlay'.
+    CI->createFileManager(clang::createVFSFromCompilerInvocation(
+      CI->getInvocation(), CI->getDiagnostics(), vfs));
+  }
+#endif
+
   // Set frontend options we captured directly.
   CI->getFrontendOpts().OutputFile = opts.OutputFile;
+  if (!opts.UnityHeaders.empty()) {
+    // Parse a source including the unity headers in place of the input.
+    clang::FrontendOptions& fo = CI->getFrontendOpts();
+    char const* unityFile = "castxml-unity.cxx";
+    fo.Inputs[0] = clang::FrontendInputFile(unityFile, fo.Inputs[0].getKind());
+    CI->getPreprocessorOpts().addRemappedFile(
+      unityFile,
+      llvm::MemoryBuffer::getMemBufferCopy(makeUnitySource(opts.UnityHeaders),
+                                           unityFile)
+        .release());
+  }
+  if (opts.SkipFunctionBodies) {
+    // Sema still parses bodies of constexpr functions and functions
+    // with deduced return types because declarations may depend on them.
+    CI->getFrontendOpts().SkipFunctionBodies = true;
+  }
 
   if (opts.GccXml) {
 #define MSG(x) "error: '--castxml-gccxml' does not work with " x "\n"
     if (isObjC(CI)) {
-      std::cerr << MSG("Objective C");
+      errs << MSG("Objective C");
       return false;
     }
 #undef MSG
@@ -781,17 +1258,24 @@ static bool runClangCI(clang::CompilerInstance* CI, Options const& opts)
   if (opts.CastXml) {
 #define MSG(x) "error: '--castxml-output=<v>' does not work with " x "\n"
     if (isObjC(CI)) {
-      std::cerr << MSG("Objective C");
+      errs << MSG("Objective C");
       return false;
     }
 #undef MSG
   }
 
+#if LLVM_VERSION_MAJOR < 9
+  if (!opts.EmitAST.empty()) {
+    errs << "error: '--castxml-emit-ast' requires Clang 9 or above\n";
+    return false;
+  }
+#endif
+
   // Construct our Clang front-end action.  This dispatches
   // handling of each input file with an action based on the
   // flags provided (e.g. -E to preprocess-only).
   std::unique_ptr<clang::FrontendAction> action(
-    CreateFrontendAction(CI, opts));
+    CreateFrontendAction(CI, opts, errs));
   if (action) {
     return CI->ExecuteAction(*action);
   } else {
@@ -800,7 +1284,12 @@ static bool runClangCI(clang::CompilerInstance* CI, Options const& opts)
 }
 
 static int runClangImpl(char const* const* argBeg, char const* const* argEnd,
-                        Options const& opts)
+                        Options const& opts, llvm::raw_ostream& errs
+#if LLVM_VERSION_MAJOR >= 9
+                        ,
+                        llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> baseFS
+#endif
+)
 {
   // Construct a diagnostics engine for use while processing driver options.
 #if LLVM_VERSION_MAJOR >= 21
@@ -839,7 +1328,7 @@ static int runClangImpl(char const* const* argBeg, char const* const* argEnd,
     driverOpts->ParseArgs(argBeg, argEnd, missingArgIndex, missingArgCount));
   clang::ParseDiagnosticArgs(diagOptsRef, *args);
 #endif
-  clang::TextDiagnosticPrinter diagClient(llvm::errs(), diagOptsPtr);
+  clang::TextDiagnosticPrinter diagClient(errs, diagOptsPtr);
   clang::DiagnosticsEngine diags(diagID, diagOptsPtr, &diagClient,
                                  /*ShouldOwnClient=*/false);
   clang::ProcessWarningOptions(diags, diagOptsRef,
@@ -848,12 +1337,36 @@ static int runClangImpl(char const* const* argBeg, char const* const* argEnd,
 #endif
                                /*ReportDiags=*/false);
 
+#if LLVM_VERSION_MAJOR >= 9
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> vfs = baseFS;
+  if (!opts.VirtualFiles.empty()) {
+    vfs = createVirtualFiles(
+      opts, baseFS ? baseFS : llvm::vfs::getRealFileSystem(), errs);
+    if (!vfs) {
+      return 1;
+    }
+  }
+#else
+  if (!opts.VirtualFiles.empty()) {
+    errs << "error: '--castxml-virtual-file' requires Clang 9 or above\n";
+    return 1;
+  }
+#endif
+
   // Use the approach in clang::createInvocationFromCommandLine to
   // get system compiler setting arguments from the Driver.
-  clang::driver::Driver d("clang", llvm::sys::getDefaultTargetTriple(), diags);
+  clang::driver::Driver d("clang", llvm::sys::getDefaultTargetTriple(), diags
+#if LLVM_VERSION_MAJOR >= 10
+                          ,
+                          "clang LLVM compiler", vfs
+#elif LLVM_VERSION_MAJOR >= 9
+                          ,
+                          vfs
+#endif
+  );
   if (!llvm::sys::path::is_absolute(d.ResourceDir) ||
       !llvm::sys::fs::is_directory(d.ResourceDir)) {
-    d.ResourceDir = getClangResourceDir();
+    d.ResourceDir = opts.ClangResourceDir;
   }
   llvm::SmallVector<char const*, 16> cArgs;
   cArgs.push_back("<clang>");
@@ -874,12 +1387,16 @@ static int runClangImpl(char const* const* argBeg, char const* const* argEnd,
 
   // For '-###' just print the jobs and exit early.
   if (c->getArgs().hasArg(CASTXML_CLANG_OPTIONS::OPT__HASH_HASH_HASH)) {
-    c->getJobs().Print(llvm::errs(), "\n", true);
+    c->getJobs().Print(errs, "\n", true);
     return 0;
   }
 
-  // Reject '-o' with multiple inputs.
-  if (!opts.OutputFile.empty() && c->getJobs().size() > 1) {
+  // Reject options naming output files with multiple inputs.
+  if ((!opts.OutputFile.empty() || !opts.Queries.empty() ||
+       !opts.EmitAST.empty() || !opts.Delta.empty() ||
+       !opts.IndexFile.empty() || !opts.ShardBy.empty() ||
+       !opts.UnityHeaders.empty() || opts.Sink) &&
+      c->getJobs().size() > 1) {
     diags.Report(clang::diag::err_drv_output_argument_with_multiple_files);
     return 1;
   }
@@ -909,7 +1426,13 @@ static int runClangImpl(char const* const* argBeg, char const* const* argEnd,
         if (diags.hasErrorOccurred()) {
           return 1;
         }
-        result = runClangCI(CI.get(), opts) && result;
+        result = runClangCI(CI.get(), opts, errs
+#if LLVM_VERSION_MAJOR >= 9
+                            ,
+                            vfs
+#endif
+                            ) &&
+          result;
       } else {
         result = false;
       }
@@ -926,20 +1449,26 @@ static int runClangImpl(char const* const* argBeg, char const* const* argEnd,
   return result ? 0 : 1;
 }
 
-int runClang(char const* const* argBeg, char const* const* argEnd,
-             Options const& opts)
+static int runClangArgs(char const* const* argBeg, char const* const* argEnd,
+                        Options const& opts, llvm::raw_ostream& errs
+#if LLVM_VERSION_MAJOR >= 9
+                        ,
+                        llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> baseFS
+#endif
+)
 {
   llvm::SmallVector<char const*, 32> args(argBeg, argEnd);
   std::string fmsc_version = "-fmsc-version=";
   std::string std_flag = "-std=";
 
-  if (opts.HaveCC) {
-    // Configure target to match that of given compiler.
-    if (!opts.HaveTarget && !opts.Triple.empty()) {
-      args.push_back("-target");
-      args.push_back(opts.Triple.c_str());
-    }
+  // Configure target to match that of given compiler or the one
+  // selected by '--castxml-targets'.
+  if (!opts.HaveTarget && !opts.Triple.empty()) {
+    args.push_back("-target");
+    args.push_back(opts.Triple.c_str());
+  }
 
+  if (opts.HaveCC) {
     // Tell Clang driver not to add its header search paths.
     args.push_back("-nobuiltininc");
     args.push_back("-nostdlibinc");
@@ -1123,5 +1652,64 @@ int runClang(char const* const* argBeg, char const* const* argEnd,
     }
   }
 
-  return runClangImpl(args.data(), args.data() + args.size(), opts);
+  return runClangImpl(args.data(), args.data() + args.size(), opts, errs
+#if LLVM_VERSION_MAJOR >= 9
+                      ,
+                      baseFS
+#endif
+  );
+}
+
+int runClang(char const* const* argBeg, char const* const* argEnd,
+             Options const& opts)
+{
+  return runClangArgs(argBeg, argEnd, opts, llvm::errs()
+#if LLVM_VERSION_MAJOR >= 9
+                      ,
+                      nullptr
+#endif
+  );
+}
+
+int runClangTargets(char const* const* argBeg, char const* const* argEnd,
+                    std::vector<Options> const& targets)
+{
+#if LLVM_VERSION_MAJOR >= 9
+  // Parse for all targets at once, each in its own thread with its own
+  // compiler instance.  The instances' FileManagers are not thread-safe
+  // so they cannot be shared, but they read files through one cache so
+  // each file is read from disk only once.  Each target buffers its
+  // diagnostics so they can be reported in target order without the
+  // instances' messages interleaving.
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> cache =
+    createSharedFileCache();
+  std::vector<int> results(targets.size(), 1);
+  std::vector<std::string> diagnostics(targets.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < targets.size(); ++i) {
+    threads.emplace_back([&, i]() {
+      llvm::raw_string_ostream errs(diagnostics[i]);
+      results[i] = runClangArgs(argBeg, argEnd, targets[i], errs, cache);
+      errs.flush();
+    });
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  for (std::string const& d : diagnostics) {
+    llvm::errs() << d;
+  }
+  for (int r : results) {
+    if (r != 0) {
+      return r;
+    }
+  }
+  return 0;
+#else
+  static_cast<void>(argBeg);
+  static_cast<void>(argEnd);
+  static_cast<void>(targets);
+  std::cerr << "error: '--castxml-targets' requires Clang 9 or above\n";
+  return 1;
+#endif
 }
@@ -16,10 +16,17 @@
 #ifndef CASTXML_RUNCLANG_H
 #define CASTXML_RUNCLANG_H
 
+#include <vector>
+
 struct Options;
 
 /// runClang - Run Clang with given user arguments and detected options.
 int runClang(char const* const* argBeg, char const* const* argEnd,
              Options const& opts);
 
+/// runClangTargets - Run Clang with given user arguments once for each
+/// of the given options, each selecting a target, concurrently.
+int runClangTargets(char const* const* argBeg, char const* const* argEnd,
+                    std::vector<Options> const& targets);
+
 #endif // CASTXML_RUNCLANG_H
@@ -0,0 +1,129 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Unity.h"
+
+#include "llvm/Config/llvm-config.h"
+
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Token.h"
+
+#include <algorithm>
+
+std::string makeUnitySource(std::vector<std::string> const& headers)
+{
+  std::string source;
+  for (std::string header : headers) {
+    std::replace(header.begin(), header.end(), '\\', '/');
+    source += "#include \"" + header + "\"\n";
+  }
+  return source;
+}
+
+class UnityCallbacks : public clang::PPCallbacks
+{
+  UnityIncludes& Unity;
+  clang::SourceManager& SM;
+
+  void AddInclude(clang::FileID includer, clang::FileID included)
+  {
+    if (included.isInvalid() || !this->SM.getFileEntryForID(included)) {
+      // Skip the predefines buffer.
+      return;
+    }
+    if (includer == this->SM.getMainFileID()) {
+      this->Unity.Headers.push_back(included);
+    }
+    this->Unity.Includes[includer].insert(included);
+  }
+
+public:
+  UnityCallbacks(UnityIncludes& unity, clang::SourceManager& sm)
+    : Unity(unity)
+    , SM(sm)
+  {
+  }
+
+  void FileChanged(clang::SourceLocation loc, FileChangeReason reason,
+                   clang::SrcMgr::CharacteristicKind,
+                   clang::FileID prevFID) override
+  {
+    if (reason == EnterFile) {
+      this->AddInclude(prevFID, this->SM.getFileID(loc));
+    }
+  }
+
+  // Files skipped by include guards or '#pragma once' were entered
+  // earlier from another file, but are reached from this one too.
+#if LLVM_VERSION_MAJOR >= 10
+  void FileSkipped(clang::FileEntryRef const& skippedFile,
+                   clang::Token const& filenameTok,
+                   clang::SrcMgr::CharacteristicKind) override
+  {
+    this->Skipped(&skippedFile.getFileEntry(), filenameTok);
+  }
+#else
+  void FileSkipped(clang::FileEntry const& skippedFile,
+                   clang::Token const& filenameTok,
+                   clang::SrcMgr::CharacteristicKind) override
+  {
+    this->Skipped(&skippedFile, filenameTok);
+  }
+#endif
+
+  void Skipped(clang::FileEntry const* f, clang::Token const& filenameTok)
+  {
+    clang::SourceLocation loc =
+      this->SM.getExpansionLoc(filenameTok.getLocation());
+    this->AddInclude(this->SM.getFileID(loc), this->SM.translateFile(f));
+  }
+};
+
+std::unique_ptr<clang::PPCallbacks> UnityIncludes::CreateCallbacks(
+  clang::SourceManager& sm)
+{
+  return std::unique_ptr<clang::PPCallbacks>(new UnityCallbacks(*this, sm));
+}
+
+void UnityIncludes::Finish(clang::SourceManager const& sm)
+{
+  for (unsigned int h = 0; h < this->Headers.size(); ++h) {
+    std::set<clang::FileID> seen;
+    std::vector<clang::FileID> stack(1, this->Headers[h]);
+    while (!stack.empty()) {
+      clang::FileID fid = stack.back();
+      stack.pop_back();
+      if (!seen.insert(fid).second) {
+        continue;
+      }
+      if (clang::FileEntry const* f = sm.getFileEntryForID(fid)) {
+        this->Reaching[f].insert(h);
+      }
+      auto i = this->Includes.find(fid);
+      if (i != this->Includes.end()) {
+        stack.insert(stack.end(), i->second.begin(), i->second.end());
+      }
+    }
+  }
+}
+
+std::set<unsigned int> const* UnityIncludes::getHeadersReaching(
+  clang::FileEntry const* f) const
+{
+  auto i = this->Reaching.find(f);
+  return i != this->Reaching.end() ? &i->second : nullptr;
+}
@@ -0,0 +1,69 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#ifndef CASTXML_UNITY_H
+#define CASTXML_UNITY_H
+
+#include "clang/Basic/SourceLocation.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace clang {
+class FileEntry;
+class PPCallbacks;
+class SourceManager;
+}
+
+/// makeUnitySource - Make the source of a translation unit that includes
+/// each of the given headers in order.
+std::string makeUnitySource(std::vector<std::string> const& headers);
+
+/// UnityIncludes - Record the files included by each file while parsing
+/// a unity source, including files skipped by include guards, to find
+/// the headers from which each file was reached.
+class UnityIncludes
+{
+public:
+  /// CreateCallbacks - Create preprocessor callbacks that record
+  /// inclusions in this object.
+  std::unique_ptr<clang::PPCallbacks> CreateCallbacks(
+    clang::SourceManager& sm);
+
+  /// Finish - Compute the headers reaching each file after parsing.
+  void Finish(clang::SourceManager const& sm);
+
+  /// getHeaders - Get the files included by the unity source in order.
+  std::vector<clang::FileID> const& getHeaders() const
+  {
+    return this->Headers;
+  }
+
+  /// getHeadersReaching - Get the indexes in getHeaders() of headers
+  /// from which a file was reached, or null if none.
+  std::set<unsigned int> const* getHeadersReaching(
+    clang::FileEntry const* f) const;
+
+private:
+  friend class UnityCallbacks;
+  std::vector<clang::FileID> Headers;
+  std::map<clang::FileID, std::set<clang::FileID>> Includes;
+  std::map<clang::FileEntry const*, std::set<unsigned int>> Reaching;
+};
+
+#endif // CASTXML_UNITY_H
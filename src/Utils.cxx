@@ -19,6 +19,7 @@
 
 #include "llvm/Config/llvm-config.h"
 
+#include <cstdint>
 #include <fstream>
 #if LLVM_VERSION_MAJOR >= 16
 #  include <optional>
@@ -26,22 +27,16 @@
 #  include <llvm/ADT/Optional.h>
 #endif
 #include <llvm/ADT/SmallString.h>
+#include <llvm/Support/Errno.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Path.h>
 #include <llvm/Support/Program.h>
+#include <string.h>
 #include <system_error>
 #include <vector>
 
-static std::string castxmlResourceDir;
-static std::string castxmlClangResourceDir;
-
-static std::string GetMainExecutable(char const* argv0)
-{
-  return llvm::sys::fs::getMainExecutable(argv0,
-                                          (void*)(intptr_t)GetMainExecutable);
-}
-
-static bool tryBuildDir(std::string const& dir)
+static bool tryBuildDir(std::string const& dir, std::string& resourceDir,
+                        std::string& clangResourceDir)
 {
   // Build tree has
   //   <build>/CMakeFiles/castxmlSourceDir.txt
@@ -54,21 +49,16 @@ static bool tryBuildDir(std::string const& dir)
   std::string cl_dir;
   if (std::getline(src_fin, src_dir) && llvm::sys::fs::is_directory(src_dir) &&
       std::getline(cl_fin, cl_dir) && llvm::sys::fs::is_directory(cl_dir)) {
-    castxmlResourceDir = src_dir + "/share/castxml";
-    castxmlClangResourceDir = cl_dir;
+    resourceDir = src_dir + "/share/castxml";
+    clangResourceDir = cl_dir;
     return true;
   }
   return false;
 }
 
-bool findResourceDir(char const* argv0, std::ostream& error)
+bool findResourceDir(std::string const& exe, std::string& resourceDir,
+                     std::string& clangResourceDir, std::ostream& error)
 {
-  std::string exe = GetMainExecutable(argv0);
-  if (!llvm::sys::path::is_absolute(exe)) {
-    error << "error: unable to locate " << argv0 << "\n";
-    return false;
-  }
-
   // Install tree has
   //   <prefix>/bin/castxml
   //   <prefix>/<CASTXML_INSTALL_DATA_DIR>
@@ -76,16 +66,16 @@ bool findResourceDir(char const* argv0, std::ostream& error)
   llvm::SmallString<16> dir(exe);
   llvm::sys::path::remove_filename(dir);
   llvm::sys::path::remove_filename(dir);
-  castxmlResourceDir = std::string(dir.str()) + "/" + CASTXML_INSTALL_DATA_DIR;
-  castxmlClangResourceDir = castxmlResourceDir + "/clang";
-  if (!llvm::sys::fs::is_directory(castxmlResourceDir) ||
-      !llvm::sys::fs::is_directory(castxmlClangResourceDir)) {
+  resourceDir = std::string(dir.str()) + "/" + CASTXML_INSTALL_DATA_DIR;
+  clangResourceDir = resourceDir + "/clang";
+  if (!llvm::sys::fs::is_directory(resourceDir) ||
+      !llvm::sys::fs::is_directory(clangResourceDir)) {
     llvm::SmallString<16> dir2(dir);
     llvm::sys::path::remove_filename(dir2);
     // Build tree has
     //   <build>/bin[/<config>]/castxml
-    if (!tryBuildDir(std::string(dir.str())) &&
-        !tryBuildDir(std::string(dir2.str()))) {
+    if (!tryBuildDir(std::string(dir.str()), resourceDir, clangResourceDir) &&
+        !tryBuildDir(std::string(dir2.str()), resourceDir, clangResourceDir)) {
       error << "Unable to locate resources for " << exe << "\n";
       return false;
     }
@@ -94,16 +84,6 @@ bool findResourceDir(char const* argv0, std::ostream& error)
   return true;
 }
 
-std::string getResourceDir()
-{
-  return castxmlResourceDir;
-}
-
-std::string getClangResourceDir()
-{
-  return castxmlClangResourceDir;
-}
-
 std::string getVersionString()
 {
   return CASTXML_VERSION_STRING;
@@ -124,17 +104,149 @@ unsigned int getVersionPatch()
   return CASTXML_VERSION_PATCH;
 }
 
-bool runCommand(int argc, char const* const* argv, int& ret, std::string& out,
-                std::string& err, std::string& msg, std::string* maybeTmpDir)
+#if !defined(_WIN32)
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <signal.h>
+#  include <spawn.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+extern char** environ;
+
+static void closePipe(int p[2])
 {
-  // Find the program to run.
-  llvm::ErrorOr<std::string> maybeProg = llvm::sys::findProgramByName(argv[0]);
-  if (std::error_code e = maybeProg.getError()) {
-    msg = e.message();
+  if (p[0] >= 0) {
+    close(p[0]);
+  }
+  if (p[1] >= 0) {
+    close(p[1]);
+  }
+}
+
+// Create a pipe whose ends are not inherited by children spawned
+// concurrently from other threads.
+static bool openPipe(int p[2])
+{
+#  if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) ||  \
+    defined(__OpenBSD__)
+  return pipe2(p, O_CLOEXEC) == 0;
+#  else
+  if (pipe(p) != 0) {
     return false;
   }
-  std::string const& prog = *maybeProg;
+  fcntl(p[0], F_SETFD, FD_CLOEXEC);
+  fcntl(p[1], F_SETFD, FD_CLOEXEC);
+  return true;
+#  endif
+}
+
+static bool runCommandPipes(std::string const& prog, int argc,
+                            char const* const* argv, int& ret,
+                            std::string& out, std::string& err,
+                            std::string& msg)
+{
+  // Create pipes for the child's stdout and stderr.
+  int outPipe[2] = { -1, -1 };
+  int errPipe[2] = { -1, -1 };
+  if (!openPipe(outPipe) || !openPipe(errPipe)) {
+    closePipe(outPipe);
+    closePipe(errPipe);
+    return false;
+  }
+
+  // Connect the write ends to the child and give it no input.
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_adddup2(&actions, outPipe[1], 1);
+  posix_spawn_file_actions_adddup2(&actions, errPipe[1], 2);
+  posix_spawn_file_actions_addclose(&actions, outPipe[0]);
+  posix_spawn_file_actions_addclose(&actions, outPipe[1]);
+  posix_spawn_file_actions_addclose(&actions, errPipe[0]);
+  posix_spawn_file_actions_addclose(&actions, errPipe[1]);
+
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    args.push_back(const_cast<char*>(argv[i]));
+  }
+  args.push_back(nullptr);
+
+  pid_t pid;
+  int e =
+    posix_spawn(&pid, prog.c_str(), &actions, nullptr, &args[0], environ);
+  posix_spawn_file_actions_destroy(&actions);
+  close(outPipe[1]);
+  close(errPipe[1]);
+  if (e != 0) {
+    close(outPipe[0]);
+    close(errPipe[0]);
+    return false;
+  }
+
+  // Drain both pipes as data arrive so the child never blocks on a full
+  // pipe while we wait on the other one.
+  struct pollfd fds[2];
+  fds[0].fd = outPipe[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = errPipe[0];
+  fds[1].events = POLLIN;
+  std::string* bufs[2] = { &out, &err };
+  out.clear();
+  err.clear();
+  char buf[4096];
+  int remaining = 2;
+  while (remaining > 0) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    for (int i = 0; i < 2; ++i) {
+      if (fds[i].fd < 0 || !fds[i].revents) {
+        continue;
+      }
+      ssize_t n = read(fds[i].fd, buf, sizeof(buf));
+      if (n > 0) {
+        bufs[i]->append(buf, static_cast<std::size_t>(n));
+      } else if (n == 0 || errno != EINTR) {
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        --remaining;
+      }
+    }
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (fds[i].fd >= 0) {
+      close(fds[i].fd);
+    }
+  }
+
+  // Wait for the child and report its exit code like ExecuteAndWait.
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      msg = llvm::sys::StrError(errno);
+      ret = -1;
+      return true;
+    }
+  }
+  if (WIFEXITED(status)) {
+    ret = WEXITSTATUS(status);
+  } else {
+    msg = "terminated by signal " + std::to_string(WTERMSIG(status));
+    ret = -2;
+  }
+  return true;
+}
+#endif
 
+static void runCommandFiles(std::string const& prog, int argc,
+                            char const* const* argv, int& ret,
+                            std::string& out, std::string& err,
+                            std::string& msg, std::string* maybeTmpDir)
+{
   // Create a temporary directory to hold output files.
   llvm::SmallString<128> tmpDir;
   if (maybeTmpDir) {
@@ -142,7 +254,8 @@ bool runCommand(int argc, char const* const* argv, int& ret, std::string& out,
   } else if (std::error_code e =
                llvm::sys::fs::createUniqueDirectory("castxml", tmpDir)) {
     msg = e.message();
-    return false;
+    ret = -1;
+    return;
   }
   llvm::SmallString<128> tmpOut = tmpDir;
   tmpOut.append("/out");
@@ -206,7 +319,28 @@ bool runCommand(int argc, char const* const* argv, int& ret, std::string& out,
   if (!maybeTmpDir) {
     llvm::sys::fs::remove(llvm::Twine(tmpDir));
   }
+}
 
+bool runCommand(int argc, char const* const* argv, int& ret, std::string& out,
+                std::string& err, std::string& msg, std::string* maybeTmpDir)
+{
+  // Find the program to run.
+  llvm::ErrorOr<std::string> maybeProg = llvm::sys::findProgramByName(argv[0]);
+  if (std::error_code e = maybeProg.getError()) {
+    msg = e.message();
+    return false;
+  }
+  std::string const& prog = *maybeProg;
+
+#if !defined(_WIN32)
+  // Capture output through pipes if possible.
+  if (runCommandPipes(prog, argc, argv, ret, out, err, msg)) {
+    return ret >= 0;
+  }
+#endif
+
+  // Capture output through temporary files.
+  runCommandFiles(prog, argc, argv, ret, out, err, msg, maybeTmpDir);
   return ret >= 0;
 }
 
@@ -248,6 +382,38 @@ std::string encodeXML(std::string const& in, bool cdata)
   return xml;
 }
 
+std::string decodeXML(std::string const& in)
+{
+  static struct
+  {
+    char const* Entity;
+    char Char;
+  } const entities[] = {
+    { "&amp;", '&' },  { "&lt;", '<' },   { "&gt;", '>' },
+    { "&apos;", '\'' }, { "&quot;", '"' },
+  };
+  std::string str;
+  std::string::size_type pos = 0;
+  for (;;) {
+    std::string::size_type amp = in.find('&', pos);
+    str.append(in, pos, amp - pos);
+    if (amp == std::string::npos) {
+      break;
+    }
+    pos = amp + 1;
+    char c = '&';
+    for (auto const& e : entities) {
+      if (in.compare(amp, strlen(e.Entity), e.Entity) == 0) {
+        c = e.Char;
+        pos = amp + strlen(e.Entity);
+        break;
+      }
+    }
+    str += c;
+  }
+  return str;
+}
+
 std::string stringReplace(std::string str, std::string const& in,
                           std::string const& out)
 {
@@ -259,6 +425,17 @@ std::string stringReplace(std::string str, std::string const& in,
   return str;
 }
 
+uint64_t hashString(std::string const& str)
+{
+  // 64-bit FNV-1a.
+  std::uint64_t h = 14695981039346656037ull;
+  for (char c : str) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
 #if defined(_WIN32)
 #  include <windows.h>
 #endif
@@ -269,3 +446,36 @@ void suppressInteractiveErrors()
   SetErrorMode(SEM_FAILCRITICALERRORS | SEM_NOGPFAULTERRORBOX);
 #endif
 }
+
+#if defined(_WIN32)
+#  include <psapi.h>
+#elif defined(__APPLE__)
+#  include <mach/mach.h>
+#endif
+
+unsigned long long getResidentSetSize()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+    return pmc.WorkingSetSize;
+  }
+#elif defined(__APPLE__)
+  mach_task_basic_info_data_t info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                reinterpret_cast<task_info_t>(&info),
+                &count) == KERN_SUCCESS) {
+    return info.resident_size;
+  }
+#elif defined(__linux__)
+  // The second field is the number of resident pages.
+  std::ifstream statm("/proc/self/statm");
+  unsigned long long size = 0;
+  unsigned long long resident = 0;
+  if (statm >> size >> resident) {
+    return resident * static_cast<unsigned long long>(sysconf(_SC_PAGESIZE));
+  }
+#endif
+  return 0;
+}
@@ -16,18 +16,15 @@
 #ifndef CASTXML_UTILS_H
 #define CASTXML_UTILS_H
 
+#include <cstdint>
 #include <string>
 
-/// findResourceDir - Call from main() to find resources
-/// relative to the executable.  On success returns true.
+/// findResourceDir - Find resources relative to the given castxml
+/// executable.  On success stores the CastXML and Clang resource
+/// directories and returns true.
 /// On failure returns false and stores a message in the stream.
-bool findResourceDir(char const* argv0, std::ostream& error);
-
-/// getResourceDir - Get resource directory found at startup
-std::string getResourceDir();
-
-/// getClangResourceDir - Get Clang resource directory found at startup
-std::string getClangResourceDir();
+bool findResourceDir(std::string const& exe, std::string& resourceDir,
+                     std::string& clangResourceDir, std::ostream& error);
 
 /// getVersionString - Get the CastXML version string
 std::string getVersionString();
@@ -42,6 +39,8 @@ unsigned int getVersionMinor();
 unsigned int getVersionPatch();
 
 /// runCommand - Run a given command line and capture the output.
+/// Output is read through pipes where supported, and otherwise through
+/// files in maybeTmpDir or a new temporary directory.
 bool runCommand(int argc, char const* const* argv, int& ret, std::string& out,
                 std::string& err, std::string& msg,
                 std::string* maybeTmpDir = nullptr);
@@ -49,11 +48,23 @@ bool runCommand(int argc, char const* const* argv, int& ret, std::string& out,
 /// suppressInteractiveErrors - Disable Windows error dialog popups
 void suppressInteractiveErrors();
 
+/// getResidentSetSize - Get the resident set size of this process in
+/// bytes, or 0 if it cannot be determined on this platform.
+unsigned long long getResidentSetSize();
+
 /// encodeXML - Convert character string to XML representation
 std::string encodeXML(std::string const& in, bool cdata = false);
 
+/// decodeXML - Convert XML representation of an attribute value back to
+/// the character string given to encodeXML
+std::string decodeXML(std::string const& in);
+
 /// stringReplace - Replace all occurrences of an 'in' string with 'out'.
 std::string stringReplace(std::string str, std::string const& in,
                           std::string const& out);
 
+/// hashString - Compute a hash of a string that does not depend on the
+/// platform or the process, for use in persistent identifiers.
+uint64_t hashString(std::string const& str);
+
 #endif // CASTXML_UTILS_H
@@ -0,0 +1,284 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "XMLReader.h"
+
+#include <istream>
+#include <ostream>
+
+std::string const* XMLTag::getAttribute(std::string const& name) const
+{
+  for (auto const& a : this->Attributes) {
+    if (a.first == name) {
+      return &a.second;
+    }
+  }
+  return nullptr;
+}
+
+void XMLTag::setAttribute(std::string const& name, std::string const& value)
+{
+  for (auto& a : this->Attributes) {
+    if (a.first == name) {
+      a.second = value;
+      return;
+    }
+  }
+  this->Attributes.emplace_back(name, value);
+}
+
+void XMLTag::removeAttribute(std::string const& name)
+{
+  for (AttributeList::iterator i = this->Attributes.begin();
+       i != this->Attributes.end(); ++i) {
+    if (i->first == name) {
+      this->Attributes.erase(i);
+      return;
+    }
+  }
+}
+
+std::string XMLElement::getId() const
+{
+  std::string const* id = this->Head.getAttribute("id");
+  return id ? *id : std::string();
+}
+
+XMLElementReader::XMLElementReader(std::istream& in)
+  : In(in)
+{
+}
+
+static bool isSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool XMLElementReader::readTag(XMLTag& tag, std::string& error)
+{
+  std::streambuf* sb = this->In.rdbuf();
+  typedef std::streambuf::traits_type traits;
+
+  // Skip text up to the next tag.
+  int c;
+  while ((c = sb->sbumpc()) != traits::eof() && c != '<') {
+  }
+  if (c == traits::eof()) {
+    return false;
+  }
+
+  // Read the whole tag.  Attribute values never contain '>' unescaped,
+  // but track quotes anyway so that only the real tag end is matched.
+  std::string text;
+  bool quoted = false;
+  while ((c = sb->sbumpc()) != traits::eof()) {
+    if (c == '"') {
+      quoted = !quoted;
+    } else if (c == '>' && !quoted) {
+      break;
+    }
+    text += static_cast<char>(c);
+  }
+  if (c == traits::eof()) {
+    error = "unexpected end of file inside a tag";
+    return false;
+  }
+
+  tag.Name.clear();
+  tag.Attributes.clear();
+  if (text.empty() || text[0] == '?' || text[0] == '!') {
+    tag.Kind = XMLTag::Other;
+    return true;
+  }
+
+  std::string::size_type pos = 0;
+  if (text[0] == '/') {
+    tag.Kind = XMLTag::Close;
+    pos = 1;
+  } else if (text.back() == '/') {
+    tag.Kind = XMLTag::Empty;
+    text.pop_back();
+  } else {
+    tag.Kind = XMLTag::Open;
+  }
+
+  std::string::size_type end = pos;
+  while (end < text.size() && !isSpace(text[end])) {
+    ++end;
+  }
+  tag.Name = text.substr(pos, end - pos);
+  pos = end;
+
+  for (;;) {
+    while (pos < text.size() && isSpace(text[pos])) {
+      ++pos;
+    }
+    if (pos >= text.size()) {
+      break;
+    }
+    std::string::size_type eq = text.find('=', pos);
+    if (eq == std::string::npos || eq + 1 >= text.size() ||
+        text[eq + 1] != '"') {
+      error = "malformed attribute in tag '" + tag.Name + "'";
+      return false;
+    }
+    std::string::size_type q = text.find('"', eq + 2);
+    if (q == std::string::npos) {
+      error = "unterminated attribute value in tag '" + tag.Name + "'";
+      return false;
+    }
+    tag.Attributes.emplace_back(text.substr(pos, eq - pos),
+                                text.substr(eq + 2, q - eq - 2));
+    pos = q + 1;
+  }
+  return true;
+}
+
+bool XMLElementReader::readStart(XMLTag& root, std::string& error)
+{
+  while (this->readTag(root, error)) {
+    if (root.Kind == XMLTag::Open) {
+      this->Root = root.Name;
+      return true;
+    }
+    if (root.Kind != XMLTag::Other) {
+      break;
+    }
+  }
+  if (error.empty()) {
+    error = "no document element found";
+  }
+  return false;
+}
+
+bool XMLElementReader::readElement(XMLElement& element, std::string& error)
+{
+  element.Children.clear();
+  XMLTag& head = element.Head;
+  do {
+    if (!this->readTag(head, error)) {
+      if (error.empty()) {
+        error = "missing end of document element '" + this->Root + "'";
+      }
+      return false;
+    }
+  } while (head.Kind == XMLTag::Other);
+
+  if (head.Kind == XMLTag::Close) {
+    if (head.Name != this->Root) {
+      error = "unexpected end tag '" + head.Name + "'";
+    }
+    return false;
+  }
+
+  if (head.Kind == XMLTag::Open) {
+    unsigned int depth = 1;
+    while (depth > 0) {
+      element.Children.emplace_back();
+      XMLTag& child = element.Children.back();
+      if (!this->readTag(child, error)) {
+        if (error.empty()) {
+          error = "missing end of element '" + head.Name + "'";
+        }
+        return false;
+      }
+      if (child.Kind == XMLTag::Open) {
+        ++depth;
+      } else if (child.Kind == XMLTag::Close) {
+        --depth;
+      } else if (child.Kind == XMLTag::Other) {
+        element.Children.pop_back();
+      }
+    }
+    // The last child is the end tag of the element itself.
+    element.Children.pop_back();
+  }
+  return true;
+}
+
+XMLRefKind getXMLRefKind(std::string const& name)
+{
+  if (name == "type" || name == "context" || name == "returns" ||
+      name == "basetype" || name == "original_type" || name == "attached" ||
+      name == "comment" || name == "file") {
+    return XMLIdRef;
+  }
+  if (name == "members" || name == "bases" || name == "throw" ||
+      name == "befriending" || name == "overrides" || name == "headers") {
+    return XMLIdListRef;
+  }
+  if (name == "location") {
+    return XMLLocationRef;
+  }
+  return XMLNotRef;
+}
+
+void splitXMLRefToken(std::string const& token, std::string& prefix,
+                      std::string& id)
+{
+  std::string::size_type colon = token.rfind(':');
+  if (colon == std::string::npos) {
+    prefix.clear();
+    id = token;
+  } else {
+    prefix = token.substr(0, colon + 1);
+    id = token.substr(colon + 1);
+  }
+}
+
+void writeXMLTag(std::ostream& out, XMLTag const& tag, unsigned int indent)
+{
+  out << std::string(indent, ' ') << '<';
+  if (tag.Kind == XMLTag::Close) {
+    out << '/';
+  }
+  out << tag.Name;
+  for (auto const& a : tag.Attributes) {
+    out << ' ' << a.first << "=\"" << a.second << '"';
+  }
+  if (tag.Kind == XMLTag::Empty) {
+    out << '/';
+  }
+  out << ">\n";
+}
+
+void writeXMLElement(std::ostream& out, XMLElement const& element)
+{
+  if (element.Children.empty() && element.Head.Kind == XMLTag::Open) {
+    // Write an element whose children were removed in its short form.
+    XMLTag head = element.Head;
+    head.Kind = XMLTag::Empty;
+    writeXMLTag(out, head, 2);
+    return;
+  }
+  writeXMLTag(out, element.Head, 2);
+  unsigned int indent = 4;
+  for (XMLTag const& child : element.Children) {
+    if (child.Kind == XMLTag::Close) {
+      indent -= 2;
+    }
+    writeXMLTag(out, child, indent);
+    if (child.Kind == XMLTag::Open) {
+      indent += 2;
+    }
+  }
+  if (element.Head.Kind == XMLTag::Open) {
+    XMLTag end;
+    end.Kind = XMLTag::Close;
+    end.Name = element.Head.Name;
+    writeXMLTag(out, end, 2);
+  }
+}
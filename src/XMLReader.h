@@ -0,0 +1,105 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#ifndef CASTXML_XMLREADER_H
+#define CASTXML_XMLREADER_H
+
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// XMLTag - One tag of a castxml output file.  Attribute values
+/// are kept in their escaped form so they can be written back as-is.
+struct XMLTag
+{
+  enum TagKind
+  {
+    Open,
+    Close,
+    Empty,
+    Other
+  };
+  TagKind Kind = Other;
+  std::string Name;
+  typedef std::vector<std::pair<std::string, std::string>> AttributeList;
+  AttributeList Attributes;
+
+  /// getAttribute - Get the value of an attribute, or null if not present.
+  std::string const* getAttribute(std::string const& name) const;
+
+  /// setAttribute - Set the value of an attribute, adding it if needed.
+  void setAttribute(std::string const& name, std::string const& value);
+
+  /// removeAttribute - Remove an attribute if present.
+  void removeAttribute(std::string const& name);
+};
+
+/// XMLElement - One top-level element of a castxml output file,
+/// i.e. a child of the document element, with all of its nested tags.
+struct XMLElement
+{
+  XMLTag Head;
+  std::vector<XMLTag> Children;
+
+  /// getId - Get the value of the "id" attribute, or an empty string.
+  std::string getId() const;
+};
+
+/// XMLElementReader - Read castxml output one element at a time
+/// so that arbitrarily large files can be processed in bounded memory.
+class XMLElementReader
+{
+public:
+  XMLElementReader(std::istream& in);
+
+  /// readStart - Read up to and including the document element tag.
+  bool readStart(XMLTag& root, std::string& error);
+
+  /// readElement - Read the next top-level element.  Returns false
+  /// at the end of the document or on error, which is then non-empty.
+  bool readElement(XMLElement& element, std::string& error);
+
+private:
+  bool readTag(XMLTag& tag, std::string& error);
+  std::istream& In;
+  std::string Root;
+};
+
+/// XMLRefKind - How the value of an attribute refers to other elements.
+enum XMLRefKind
+{
+  XMLNotRef,
+  XMLIdRef,
+  XMLIdListRef,
+  XMLLocationRef
+};
+
+/// getXMLRefKind - Get how values of the named castxml attribute
+/// refer to other elements.
+XMLRefKind getXMLRefKind(std::string const& name);
+
+/// splitXMLRefToken - Split a reference list token such as "private:_5"
+/// into its prefix "private:" and the referenced id "_5".
+void splitXMLRefToken(std::string const& token, std::string& prefix,
+                      std::string& id);
+
+/// writeXMLTag - Write a tag on its own line with the given indentation.
+void writeXMLTag(std::ostream& out, XMLTag const& tag, unsigned int indent);
+
+/// writeXMLElement - Write a top-level element as castxml formats it.
+void writeXMLElement(std::ostream& out, XMLElement const& element);
+
+#endif // CASTXML_XMLREADER_H
@@ -0,0 +1,92 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "Merge.h"
+
+#include <fstream>
+#include <iostream>
+#include <string.h>
+#include <string>
+#include <vector>
+
+int main(int argc, char const** argv)
+{
+  /* clang-format off */
+  const char* usage =
+    "Usage: castxml-merge [-o <file>] <xml>...\n"
+    "\n"
+    "  Merge castxml output files into one.  Declarations and types\n"
+    "  appearing in more than one input are written once.  Element ids\n"
+    "  are renumbered and references are rewritten to match.\n"
+    "\n"
+    "Options:\n"
+    "\n"
+    "  -help, --help\n"
+    "    Print castxml-merge usage information\n"
+    "\n"
+    "  -o <file>\n"
+    "    Write output to <file> instead of standard output\n"
+    "\n"
+    ;
+  /* clang-format on */
+
+  std::string outputFile;
+  std::vector<std::string> inputs;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-o") == 0) {
+      if ((i + 1) < argc) {
+        outputFile = argv[++i];
+      } else {
+        /* clang-format off */
+        std::cerr <<
+          "error: argument to '-o' is missing (expected 1 value)\n"
+          "\n" <<
+          usage
+          ;
+        /* clang-format on */
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-help") == 0 ||
+               strcmp(argv[i], "--help") == 0) {
+      std::cout << usage;
+      return 0;
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+
+  if (inputs.empty()) {
+    /* clang-format off */
+    std::cerr <<
+      "error: no input files\n"
+      "\n" <<
+      usage
+      ;
+    /* clang-format on */
+    return 1;
+  }
+
+  if (outputFile.empty()) {
+    return mergeXML(inputs, std::cout, std::cerr) ? 0 : 1;
+  }
+
+  std::ofstream fout(outputFile.c_str(), std::ios::out | std::ios::binary);
+  if (!fout) {
+    std::cerr << "error: cannot write '" << outputFile << "'\n";
+    return 1;
+  }
+  return mergeXML(inputs, fout, std::cerr) ? 0 : 1;
+}
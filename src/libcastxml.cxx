@@ -0,0 +1,319 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "libcastxml.h"
+#include "Main.h"
+#include "Output.h"
+#include "Utils.h"
+#include "XMLReader.h"
+
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct castxml_node
+{
+  // Element name and attribute values.
+  XMLTag Tag;
+  struct Ref
+  {
+    std::string const* Attribute;
+    castxml_node const* Node;
+  };
+  std::vector<Ref> Refs;
+  std::vector<castxml_node*> Children;
+  castxml_node* Parent = nullptr;
+};
+
+struct castxml_graph
+{
+  XMLTag Root;
+  // Deques keep node addresses stable as nodes are added.
+  std::deque<castxml_node> Nodes;
+  std::deque<castxml_node> ChildNodes;
+  std::map<std::string, castxml_node*> Index;
+
+  void WriteNode(std::ostream& out, castxml_node const& node,
+                 unsigned int indent) const;
+};
+
+// Sink that adds a node to the graph for each element.  References
+// are resolved when the document ends and every node is known.
+class GraphBuilder : public OutputSink
+{
+  struct PendingRef
+  {
+    castxml_node* Node;
+    size_t Attribute;
+    std::string Id;
+  };
+
+  castxml_graph& Graph;
+  castxml_node* Node = nullptr;
+  std::vector<PendingRef> Refs;
+  bool Begun = false;
+  bool Ended = false;
+
+  std::string& Value() { return this->Node->Tag.Attributes.back().second; }
+
+public:
+  GraphBuilder(castxml_graph& graph)
+    : Graph(graph)
+  {
+  }
+
+  /** Whether a document was begun, and whether it was ended.  */
+  bool WasBegun() const { return this->Begun; }
+  bool WasEnded() const { return this->Ended; }
+
+  void BeginDocument(
+    llvm::StringRef name,
+    llvm::ArrayRef<std::pair<llvm::StringRef, llvm::StringRef>> attributes)
+    override
+  {
+    this->Begun = true;
+    this->Graph.Root.Name = name.str();
+    for (auto const& a : attributes) {
+      this->Graph.Root.Attributes.emplace_back(a.first.str(),
+                                               a.second.str());
+    }
+  }
+
+  void EndDocument() override
+  {
+    for (PendingRef const& r : this->Refs) {
+      auto i = this->Graph.Index.find(r.Id);
+      r.Node->Refs.push_back(
+        { &r.Node->Tag.Attributes[r.Attribute].first,
+          i != this->Graph.Index.end() ? i->second : nullptr });
+    }
+    this->Refs.clear();
+    this->Ended = true;
+  }
+
+  void BeginElement(llvm::StringRef name) override
+  {
+    castxml_node* node;
+    if (this->Node) {
+      this->Graph.ChildNodes.emplace_back();
+      node = &this->Graph.ChildNodes.back();
+      node->Parent = this->Node;
+      this->Node->Children.push_back(node);
+    } else {
+      this->Graph.Nodes.emplace_back();
+      node = &this->Graph.Nodes.back();
+    }
+    node->Tag.Kind = XMLTag::Empty;
+    node->Tag.Name = name.str();
+    this->Node = node;
+  }
+
+  void EndElement() override { this->Node = this->Node->Parent; }
+
+  void BeginAttribute(llvm::StringRef name) override
+  {
+    this->Node->Tag.Attributes.emplace_back(name.str(), std::string());
+  }
+
+  void EndAttribute() override {}
+
+  void Text(llvm::StringRef text) override
+  {
+    this->Value().append(text.data(), text.size());
+  }
+
+  void Id(llvm::StringRef id) override
+  {
+    this->Value().append(id.data(), id.size());
+    this->Graph.Index[id.str()] = this->Node;
+  }
+
+  void Ref(llvm::StringRef id) override
+  {
+    this->Value().append(id.data(), id.size());
+    this->Refs.push_back(
+      { this->Node, this->Node->Tag.Attributes.size() - 1, id.str() });
+  }
+};
+
+void castxml_graph::WriteNode(std::ostream& out, castxml_node const& node,
+                              unsigned int indent) const
+{
+  XMLTag tag;
+  tag.Name = node.Tag.Name;
+  for (auto const& a : node.Tag.Attributes) {
+    tag.Attributes.emplace_back(a.first, encodeXML(a.second));
+  }
+  tag.Kind = node.Children.empty() ? XMLTag::Empty : XMLTag::Open;
+  writeXMLTag(out, tag, indent);
+  if (!node.Children.empty()) {
+    for (castxml_node const* child : node.Children) {
+      this->WriteNode(out, *child, indent + 2);
+    }
+    tag.Kind = XMLTag::Close;
+    tag.Attributes.clear();
+    writeXMLTag(out, tag, indent);
+  }
+}
+
+int castxml_run(char const* exe, int argc, char const* const* argv,
+                castxml_graph** graph)
+{
+  *graph = nullptr;
+
+  std::vector<char const*> args;
+  args.push_back("castxml");
+  args.insert(args.end(), argv, argv + argc);
+
+  std::unique_ptr<castxml_graph> g(new castxml_graph);
+  GraphBuilder builder(*g);
+  int ret = castxmlMain(int(args.size()), args.data(), exe, &builder);
+  if (!builder.WasBegun()) {
+    return ret;
+  }
+
+  // A document that was not ended is incomplete.
+  if (!builder.WasEnded()) {
+    return ret ? ret : 1;
+  }
+  *graph = g.release();
+  return ret;
+}
+
+void castxml_graph_free(castxml_graph* graph)
+{
+  delete graph;
+}
+
+char const* castxml_graph_root(castxml_graph const* graph)
+{
+  return graph->Root.Name.c_str();
+}
+
+char const* castxml_graph_attribute(castxml_graph const* graph,
+                                    char const* name)
+{
+  std::string const* value = graph->Root.getAttribute(name);
+  return value ? value->c_str() : nullptr;
+}
+
+size_t castxml_graph_size(castxml_graph const* graph)
+{
+  return graph->Nodes.size();
+}
+
+castxml_node const* castxml_graph_node(castxml_graph const* graph,
+                                       size_t index)
+{
+  return index < graph->Nodes.size() ? &graph->Nodes[index] : nullptr;
+}
+
+castxml_node const* castxml_graph_find(castxml_graph const* graph,
+                                       char const* id)
+{
+  auto i = graph->Index.find(id);
+  return i != graph->Index.end() ? i->second : nullptr;
+}
+
+int castxml_graph_write(castxml_graph const* graph, char const* file)
+{
+  std::ofstream out(file, std::ios::out | std::ios::binary);
+  if (!out) {
+    return 1;
+  }
+  XMLTag root = graph->Root;
+  for (auto& a : root.Attributes) {
+    a.second = encodeXML(a.second);
+  }
+  out << "<?xml version=\"1.0\"?>\n";
+  writeXMLTag(out, root, 0);
+  for (castxml_node const& node : graph->Nodes) {
+    graph->WriteNode(out, node, 2);
+  }
+  out << "</" << root.Name << ">\n";
+  return out ? 0 : 1;
+}
+
+char const* castxml_node_kind(castxml_node const* node)
+{
+  return node->Tag.Name.c_str();
+}
+
+char const* castxml_node_id(castxml_node const* node)
+{
+  return castxml_node_get(node, "id");
+}
+
+size_t castxml_node_attribute_count(castxml_node const* node)
+{
+  return node->Tag.Attributes.size();
+}
+
+char const* castxml_node_attribute_name(castxml_node const* node,
+                                        size_t index)
+{
+  return index < node->Tag.Attributes.size()
+    ? node->Tag.Attributes[index].first.c_str()
+    : nullptr;
+}
+
+char const* castxml_node_attribute_value(castxml_node const* node,
+                                         size_t index)
+{
+  return index < node->Tag.Attributes.size()
+    ? node->Tag.Attributes[index].second.c_str()
+    : nullptr;
+}
+
+char const* castxml_node_get(castxml_node const* node, char const* name)
+{
+  std::string const* value = node->Tag.getAttribute(name);
+  return value ? value->c_str() : nullptr;
+}
+
+size_t castxml_node_ref_count(castxml_node const* node)
+{
+  return node->Refs.size();
+}
+
+char const* castxml_node_ref_attribute(castxml_node const* node, size_t index)
+{
+  return index < node->Refs.size() ? node->Refs[index].Attribute->c_str()
+                                   : nullptr;
+}
+
+castxml_node const* castxml_node_ref(castxml_node const* node, size_t index)
+{
+  return index < node->Refs.size() ? node->Refs[index].Node : nullptr;
+}
+
+size_t castxml_node_child_count(castxml_node const* node)
+{
+  return node->Children.size();
+}
+
+castxml_node const* castxml_node_child(castxml_node const* node, size_t index)
+{
+  return index < node->Children.size() ? node->Children[index] : nullptr;
+}
+
+castxml_node const* castxml_node_parent(castxml_node const* node)
+{
+  return node->Parent;
+}
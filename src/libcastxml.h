@@ -0,0 +1,125 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#ifndef LIBCASTXML_H
+#define LIBCASTXML_H
+
+/* C interface to run castxml in-process and inspect its output as a graph
+   of nodes in memory instead of reading an XML file back.  The graph is
+   built as the output is produced, without formatting it as XML.  */
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(LIBCASTXML_SHARED)
+#  if defined(LIBCASTXML_EXPORTS)
+#    define LIBCASTXML_API __declspec(dllexport)
+#  else
+#    define LIBCASTXML_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__) && defined(LIBCASTXML_SHARED)
+#  define LIBCASTXML_API __attribute__((visibility("default")))
+#else
+#  define LIBCASTXML_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The output of one run: a set of nodes, one per output element.  */
+typedef struct castxml_graph castxml_graph;
+
+/* One output element, or a child element such as an Argument.  */
+typedef struct castxml_node castxml_node;
+
+/* Run castxml with the given arguments, as given to the castxml
+   executable without the program name.  Resources are found relative
+   to 'exe', the path to an installed castxml executable.  An output
+   format option such as '--castxml-output=1' is needed to produce a
+   graph.  Options that rewrite the XML text, such as '--castxml-hash',
+   are rejected.  Messages are written to the standard error stream.
+   On return '*graph' holds the output, or NULL if none was produced,
+   and must be released with castxml_graph_free.  Returns the exit code
+   the castxml executable would have returned.  */
+LIBCASTXML_API int castxml_run(char const* exe, int argc,
+                               char const* const* argv,
+                               castxml_graph** graph);
+
+/* Release a graph and all its nodes.  */
+LIBCASTXML_API void castxml_graph_free(castxml_graph* graph);
+
+/* Get the name of the document element, e.g. "CastXML" or "GCC_XML".  */
+LIBCASTXML_API char const* castxml_graph_root(castxml_graph const* graph);
+
+/* Get the value of an attribute of the document element, e.g.
+   "format", or NULL if it is not present.  */
+LIBCASTXML_API char const* castxml_graph_attribute(
+  castxml_graph const* graph, char const* name);
+
+/* Get the number of top-level nodes and the node at an index, in
+   output order.  */
+LIBCASTXML_API size_t castxml_graph_size(castxml_graph const* graph);
+LIBCASTXML_API castxml_node const* castxml_graph_node(
+  castxml_graph const* graph, size_t index);
+
+/* Find a top-level node by its id, e.g. "_1" or "f1", or NULL.  */
+LIBCASTXML_API castxml_node const* castxml_graph_find(
+  castxml_graph const* graph, char const* id);
+
+/* Write the graph as XML in the format it was produced with.
+   Returns 0 on success.  */
+LIBCASTXML_API int castxml_graph_write(castxml_graph const* graph,
+                                       char const* file);
+
+/* Get the element name of a node, e.g. "Function".  */
+LIBCASTXML_API char const* castxml_node_kind(castxml_node const* node);
+
+/* Get the id of a node, or NULL for a child node without one.  */
+LIBCASTXML_API char const* castxml_node_id(castxml_node const* node);
+
+/* Get the attributes of a node in output order.  The value of an
+   attribute referencing other nodes is its text, e.g. "_1 _2".  */
+LIBCASTXML_API size_t castxml_node_attribute_count(castxml_node const* node);
+LIBCASTXML_API char const* castxml_node_attribute_name(
+  castxml_node const* node, size_t index);
+LIBCASTXML_API char const* castxml_node_attribute_value(
+  castxml_node const* node, size_t index);
+
+/* Get the value of a named attribute of a node, or NULL.  */
+LIBCASTXML_API char const* castxml_node_get(castxml_node const* node,
+                                            char const* name);
+
+/* Get the references from a node to other nodes in output order.  Each
+   names the attribute holding it, e.g. "type" or "members", and the
+   referenced node.  A list attribute holds one reference per entry.  */
+LIBCASTXML_API size_t castxml_node_ref_count(castxml_node const* node);
+LIBCASTXML_API char const* castxml_node_ref_attribute(
+  castxml_node const* node, size_t index);
+LIBCASTXML_API castxml_node const* castxml_node_ref(castxml_node const* node,
+                                                    size_t index);
+
+/* Get the child nodes of a node, e.g. the Argument nodes of a
+   Function, and the parent of a child node or NULL.  */
+LIBCASTXML_API size_t castxml_node_child_count(castxml_node const* node);
+LIBCASTXML_API castxml_node const* castxml_node_child(
+  castxml_node const* node, size_t index);
+LIBCASTXML_API castxml_node const* castxml_node_parent(
+  castxml_node const* node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCASTXML_H */
@@ -0,0 +1,48 @@
+#=============================================================================
+# Copyright Kitware, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#=============================================================================
+cmake_minimum_required(VERSION 3.10)
+
+# Detect the clang compiler in-process, and by running it through 'env'
+# so that it is not recognized as clang, and compare the results.
+foreach(mode in-process subprocess)
+  if(mode STREQUAL "subprocess")
+    set(cc "(" env "${clang}" ")")
+  else()
+    set(cc "${clang}")
+  endif()
+  execute_process(
+    COMMAND ${castxml} --castxml-cc-gnu ${cc} ${src} -E -dM -v
+    OUTPUT_VARIABLE out_${mode}
+    ERROR_VARIABLE err_${mode}
+    RESULT_VARIABLE res_${mode}
+    )
+  if(res_${mode})
+    message(FATAL_ERROR "castxml failed with ${mode} detection:\n${err_${mode}}")
+  endif()
+  string(REGEX REPLACE "^.*#include <...> search starts here:\n(.*)End of search list\\..*$" "\\1"
+    inc_${mode} "${err_${mode}}")
+endforeach()
+
+if(NOT out_in-process STREQUAL out_subprocess)
+  message(SEND_ERROR
+    "Predefines detected in-process:\n${out_in-process}\n"
+    "differ from those detected by running the compiler:\n${out_subprocess}")
+endif()
+if(NOT inc_in-process STREQUAL inc_subprocess)
+  message(SEND_ERROR
+    "Include path detected in-process:\n${inc_in-process}\n"
+    "differs from that detected by running the compiler:\n${inc_subprocess}")
+endif()
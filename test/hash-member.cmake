@@ -0,0 +1,29 @@
+# Hash the same input with two types for one class member and record
+# which of the elements enclosing the member got a different hash.
+foreach(type int long)
+  execute_process(
+    COMMAND ${castxml} --castxml-output=1 --castxml-hash
+      --castxml-start start -DTYPE=${type} ${input}
+      -o cmd.hash-member-${type}.xml
+    RESULT_VARIABLE result
+    )
+  if(result)
+    message(FATAL_ERROR "castxml failed with TYPE=${type}")
+  endif()
+  file(READ cmd.hash-member-${type}.xml out)
+  foreach(e Namespace Struct Field)
+    if(NOT out MATCHES "<${e} id=\"[^\"]*\" hash=\"([0-9a-f]+)\"")
+      message(FATAL_ERROR "cmd.hash-member-${type}.xml has no ${e} hash")
+    endif()
+    set(hash_${e}_${type} "${CMAKE_MATCH_1}")
+  endforeach()
+endforeach()
+set(changed "")
+foreach(e Namespace Struct Field)
+  if(hash_${e}_int STREQUAL hash_${e}_long)
+    string(APPEND changed "${e} same\n")
+  else()
+    string(APPEND changed "${e} changed\n")
+  endif()
+endforeach()
+file(WRITE "${xml}" "${changed}")
@@ -0,0 +1,12 @@
+# Write the bytes that the index of the cmd.index test gives for some
+# of its elements so they can be checked against the elements.
+file(STRINGS cmd.index.idx entries REGEX "^element ")
+set(slices "")
+foreach(id _4 f1)
+  if(NOT entries MATCHES "(^|;)element ${id} ([0-9]+) ([0-9]+)(;|$)")
+    message(FATAL_ERROR "cmd.index.idx has no entry for element ${id}")
+  endif()
+  file(READ cmd.index.xml slice OFFSET ${CMAKE_MATCH_2} LIMIT ${CMAKE_MATCH_3})
+  string(APPEND slices "${slice}")
+endforeach()
+file(WRITE "${xml}" "${slices}")
@@ -0,0 +1 @@
+int start; ///< variable comment
@@ -0,0 +1,6 @@
+namespace start {
+struct C
+{
+  TYPE m;
+};
+}
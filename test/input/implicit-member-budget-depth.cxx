@@ -0,0 +1,12 @@
+namespace start {
+template <int N>
+struct C
+{
+  ~C() { (void)sizeof(C<N + 1>); }
+};
+struct A
+{
+  C<0> c;
+};
+typedef C<16> T; // past the default depth
+}
@@ -0,0 +1,2 @@
+void start(int a,
+           int b);
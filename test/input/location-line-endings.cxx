@@ -0,0 +1,3 @@
+// crlf
+// cr// lf-cr
+typedef int start[__LINE__];
@@ -0,0 +1,11 @@
+namespace start {
+template <typename T>
+struct S
+{
+};
+inline int g()
+{
+  return sizeof(S<long>); // used only internally
+}
+S<int> v; // reached through a type reference
+}
@@ -0,0 +1,11 @@
+namespace start {
+template <typename T>
+T f(T)
+{
+  return T();
+}
+template <>
+char f<char>(char);       // specialization
+template int f<int>(int); // instantiation
+}
+long unused = start::f<long>(0);
@@ -0,0 +1,13 @@
+namespace ns {
+template <typename T>
+class A
+{
+};
+template class A<int>;
+class B
+{
+};
+}
+namespace use {
+using ns::B;
+}
@@ -0,0 +1,8 @@
+#if __SIZEOF_LONG__ == 8
+#  warning "64-bit long"
+#else
+#  warning "32-bit long"
+#endif
+namespace start {
+long v;
+}
@@ -0,0 +1,3 @@
+namespace start {
+long v;
+}
@@ -0,0 +1,4 @@
+#include "unity-common.h"
+namespace unity {
+void fa(Common*);
+}
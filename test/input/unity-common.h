@@ -0,0 +1,6 @@
+#ifndef UNITY_COMMON_H
+#define UNITY_COMMON_H
+namespace unity {
+struct Common;
+}
+#endif
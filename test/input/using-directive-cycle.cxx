@@ -0,0 +1,10 @@
+namespace A {
+class start;
+}
+namespace B {
+using namespace A;
+}
+namespace A {
+using namespace B;
+}
+using namespace A;
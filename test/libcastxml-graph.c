@@ -0,0 +1,53 @@
+/*
+  Copyright Kitware, Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      https://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+/* Print the graph returned by libcastxml with one line per node and
+   one indented line per reference.  */
+
+#include "libcastxml.h"
+
+#include <stdio.h>
+
+int main(int argc, char const* argv[])
+{
+  castxml_graph* graph;
+  size_t i;
+  size_t r;
+  int ret;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: libcastxml-graph <castxml> <arg>...\n");
+    return 1;
+  }
+
+  ret = castxml_run(argv[1], argc - 2, argv + 2, &graph);
+  if (!graph) {
+    return ret;
+  }
+
+  for (i = 0; i < castxml_graph_size(graph); ++i) {
+    castxml_node const* node = castxml_graph_node(graph, i);
+    printf("%s %s\n", castxml_node_id(node), castxml_node_kind(node));
+    for (r = 0; r < castxml_node_ref_count(node); ++r) {
+      castxml_node const* target = castxml_node_ref(node, r);
+      printf("  %s %s\n", castxml_node_ref_attribute(node, r),
+             target ? castxml_node_id(target) : "(missing)");
+    }
+  }
+
+  castxml_graph_free(graph);
+  return ret;
+}